@@ -0,0 +1,310 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gnxi_bench - Microbenchmarks of the path and encode layers of gnxi_server.
+ *
+ * Every benchmark runs over a synthetic list of 10 to 100k entries of the
+ * gnxi-bench YANG model. Encode and Subscribe benchmarks read and write it in
+ * an in-memory datastore of the bench directory. They run against sysrepo with
+ * GNXI_BENCH_DATASTORE=sysrepo, install the model first:
+ *   sysrepoctl --install --yang=bench/gnxi-bench.yang
+ * They are skipped if the datastore is not available.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <datastore/datastore.h>
+#include <gnmi/encode/encode.h>
+#include <gnmi/subscribe.h>
+#include <utils/log.h>
+#include <utils/utils.h>
+#include <utils/xpath.h>
+
+using namespace std;
+
+#define BENCH_MODULE "gnxi-bench"
+#define BENCH_LIST "/" BENCH_MODULE ":items/item"
+#define BENCH_MIN_ENTRIES 10
+#define BENCH_MAX_ENTRIES 100000
+
+static shared_ptr<Datastore> datastore;
+static shared_ptr<Encode> encodef;
+static size_t populated = 0; //entries in the datastore
+
+static string entry_name(size_t i)
+{
+  return "item" + to_string(i);
+}
+
+/* gNMI path of a leaf of entry i */
+static gnmi::Path entry_path(size_t i)
+{
+  gnmi::Path path;
+  gnmi::PathElem *elem;
+
+  path.set_origin(BENCH_MODULE);
+  path.add_elem()->set_name("items");
+  elem = path.add_elem();
+  elem->set_name("item");
+  (*elem->mutable_key())["name"] = entry_name(i);
+  path.add_elem()->set_name("counters");
+  path.add_elem()->set_name("in-octets");
+
+  return path;
+}
+
+/* JSON IETF encoding of entries, as received in a SetRequest */
+static string entries_json(size_t entries)
+{
+  Json::Value root;
+  Json::FastWriter writer;
+
+  for (size_t i = 0; i < entries; i++) {
+    Json::Value item;
+    item["name"] = entry_name(i);
+    item["index"] = static_cast<Json::UInt>(i);
+    item["description"] = "synthetic entry " + to_string(i);
+    item["enabled"] = (i % 2 == 0);
+    item["counters"]["in-octets"] = to_string(i * 1000);
+    item["counters"]["out-octets"] = to_string(i * 2000);
+    root[BENCH_MODULE ":items"]["item"].append(item);
+  }
+
+  return writer.write(root);
+}
+
+/* Replace the content of the datastore by the given number of entries */
+static void populate(size_t entries)
+{
+  if (populated == entries)
+    return;
+
+  datastore->remove("/" BENCH_MODULE ":items");
+  for (size_t i = 0; i < entries; i++) {
+    string entry = string(BENCH_LIST) + "[name='" + entry_name(i) + "']";
+
+    datastore->set(entry + "/index", to_string(i).c_str());
+    datastore->set(entry + "/description",
+                   ("synthetic entry " + to_string(i)).c_str());
+    datastore->set(entry + "/enabled", i % 2 == 0 ? "true" : "false");
+    datastore->set(entry + "/counters/in-octets", to_string(i * 1000).c_str());
+    datastore->set(entry + "/counters/out-octets",
+                   to_string(i * 2000).c_str());
+  }
+  datastore->commit();
+  populated = entries;
+}
+
+/* Populate datastore for a benchmark, false if it must be skipped */
+static bool setup_datastore(benchmark::State &state)
+{
+  if (encodef == nullptr) {
+    state.SkipWithError("datastore not available");
+    return false;
+  }
+
+  try {
+    populate(state.range(0));
+  } catch (exception &exc) {
+    state.SkipWithError(exc.what());
+    return false;
+  }
+
+  return true;
+}
+
+/******************
+ * PATH BENCHMARKS *
+ ******************/
+
+/* Convert the gNMI path of a leaf of every entry */
+static void BM_GnmiToXpath(benchmark::State &state)
+{
+  vector<gnmi::Path> paths;
+
+  for (int64_t i = 0; i < state.range(0); i++)
+    paths.push_back(entry_path(i));
+
+  for (auto _ : state)
+    for (auto &path : paths)
+      benchmark::DoNotOptimize(gnmi_to_xpath(path));
+
+  state.SetItemsProcessed(state.iterations() * paths.size());
+}
+BENCHMARK(BM_GnmiToXpath)
+  ->RangeMultiplier(10)->Range(BENCH_MIN_ENTRIES, BENCH_MAX_ENTRIES);
+
+/* Compile paths of every entry, they stop fitting in the compiler cache
+ * above PATH_CACHE_SIZE entries */
+static void BM_PathCompile(benchmark::State &state)
+{
+  PathCompiler compiler;
+  vector<gnmi::Path> paths;
+
+  for (int64_t i = 0; i < state.range(0); i++)
+    paths.push_back(entry_path(i));
+
+  for (auto _ : state)
+    for (auto &path : paths)
+      benchmark::DoNotOptimize(compiler.compile(path));
+
+  state.SetItemsProcessed(state.iterations() * paths.size());
+}
+BENCHMARK(BM_PathCompile)
+  ->RangeMultiplier(10)->Range(BENCH_MIN_ENTRIES, BENCH_MAX_ENTRIES);
+
+/* Parse xpaths of every entry returned by the datastore, as done for every update
+ * of a Get or Subscribe response */
+static void BM_PathParse(benchmark::State &state)
+{
+  PathCompiler compiler;
+  gnmi::Path request = entry_path(0);
+  vector<string> xpaths;
+
+  request.mutable_elem(1)->clear_key();
+  for (int64_t i = 0; i < state.range(0); i++)
+    xpaths.push_back(string(BENCH_LIST) + "[name='" + entry_name(i) + "']");
+
+  for (auto _ : state) {
+    for (auto &xpath : xpaths) {
+      gnmi::Path out;
+      compiler.parse(xpath, request, nullptr, &out);
+      benchmark::DoNotOptimize(out);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * xpaths.size());
+}
+BENCHMARK(BM_PathParse)
+  ->RangeMultiplier(10)->Range(BENCH_MIN_ENTRIES, BENCH_MAX_ENTRIES);
+
+/********************
+ * ENCODE BENCHMARKS *
+ ********************/
+
+/* Read and encode every entry in JSON IETF, json_tree of each subtree */
+static void BM_JsonRead(benchmark::State &state)
+{
+  if (!setup_datastore(state))
+    return;
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(encodef->json_read(BENCH_LIST));
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_JsonRead)
+  ->RangeMultiplier(10)->Range(BENCH_MIN_ENTRIES, BENCH_MAX_ENTRIES)
+  ->Unit(benchmark::kMillisecond);
+
+/* Parse JSON IETF entries and store them in the datastore, with storeTree.
+ * Changes are discarded, they are never committed. */
+static void BM_JsonUpdate(benchmark::State &state)
+{
+  string json = entries_json(state.range(0));
+
+  if (!setup_datastore(state))
+    return;
+
+  for (auto _ : state) {
+    encodef->json_update(json);
+    state.PauseTiming();
+    datastore->discard();
+    state.ResumeTiming();
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+BENCHMARK(BM_JsonUpdate)
+  ->RangeMultiplier(10)->Range(BENCH_MIN_ENTRIES, BENCH_MAX_ENTRIES)
+  ->Unit(benchmark::kMillisecond);
+
+/***********************
+ * SUBSCRIBE BENCHMARKS *
+ ***********************/
+
+/* Build the Notification of one sample of the whole list */
+static void BM_SubscribeNotification(benchmark::State &state)
+{
+  Compression compression;
+  impl::Subscribe rpc(datastore, encodef, make_shared<PathCompiler>(),
+                      compression);
+  SubscriptionList request;
+  Subscription *sub = request.add_subscription();
+  Status status;
+
+  if (!setup_datastore(state))
+    return;
+
+  request.set_mode(SubscriptionList_Mode_STREAM);
+  request.set_encoding(gnmi::JSON_IETF);
+  sub->mutable_path()->set_origin(BENCH_MODULE);
+  sub->mutable_path()->add_elem()->set_name("items");
+  sub->mutable_path()->add_elem()->set_name("item");
+
+  for (auto _ : state) {
+    Notification notification;
+    status = rpc.BuildSubscribeNotification(&notification, request);
+    if (!status.ok()) {
+      state.SkipWithError(status.error_message().c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(notification);
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SubscribeNotification)
+  ->RangeMultiplier(10)->Range(BENCH_MIN_ENTRIES, BENCH_MAX_ENTRIES)
+  ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv)
+{
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+
+  const char *uri = getenv("GNXI_BENCH_DATASTORE");
+
+  Log(1); //errors only, logging would be measured
+
+  try {
+    datastore = Datastore::open(uri ? uri : "memory:" BENCH_YANG_DIR);
+    encodef = make_shared<Encode>(datastore);
+  } catch (exception &exc) {
+    cerr << "Datastore not available, skip datastore benchmarks: "
+         << exc.what() << endl;
+    encodef = nullptr;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+
+  /* Leave the datastore empty */
+  if (encodef != nullptr && populated > 0) {
+    datastore->remove("/" BENCH_MODULE ":items");
+    datastore->commit();
+  }
+
+  return 0;
+}
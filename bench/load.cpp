@@ -0,0 +1,706 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gnxi_load - Load generator for a running gNMI server.
+ *
+ * N workers share C connections, each one runs Get or Set RPCs in a loop, or
+ * holds a Subscribe stream (SAMPLE, ONCE or POLL), for a fixed duration.
+ * Latencies are recorded per sample, percentiles are exact.
+ *   Get, Set: RPC latency
+ *   once:     time from SubscriptionList to sync_response, one RPC per loop
+ *   poll:     time from Poll to its sync_response
+ *   stream:   time to sync_response, delay between notification timestamp
+ *             and reception, and jitter of sample intervals
+ * With --rate, requests are sent on a fixed schedule and latencies are
+ * measured from the scheduled time, so a slow server is not hidden by the
+ * load generator slowing down with it.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+
+#include <grpcpp/grpcpp.h>
+
+#include <proto/gnmi.grpc.pb.h>
+#include <utils/utils.h>
+#include <utils/xpath.h>
+
+using namespace std;
+using namespace chrono;
+using namespace gnmi;
+using grpc::ClientContext;
+using grpc::Status;
+
+/* Channel argument making every channel open its own connection */
+#define LOAD_CHANNEL_ARG "gnxi_load.channel"
+
+enum Mode { GET, SET, STREAM, ONCE, POLL };
+
+struct Config {
+  string target = "localhost:50051";
+  string ca, cert, key, tls_name; //TLS files, insecure if no CA
+  string username, password;
+  Mode mode = GET;
+  vector<string> xpaths;
+  string value; //JSON IETF value of Set
+  int workers = 1;
+  int channels = 1;
+  double duration = 10; //seconds
+  double rate = 0; //requests per second of all workers, 0 = closed loop
+  uint64_t interval = 1000; //sample interval in ms
+
+  vector<Path> paths; //parsed xpaths
+  steady_clock::time_point end;
+};
+
+/* Results of one worker, merged when all workers are done */
+struct Result {
+  uint64_t requests = 0; //RPCs, ONCE subscriptions or polls completed
+  uint64_t notifications = 0;
+  uint64_t updates = 0;
+  uint64_t bytes = 0; //size of responses
+  map<int, uint64_t> errors; //by gRPC status code
+  string last_error;
+  vector<int64_t> latency; //nanoseconds
+  vector<int64_t> delay; //stream: reception - notification timestamp
+  vector<int64_t> jitter; //stream: |measured interval - sample interval|
+
+  void error(const Status &status)
+  {
+    errors[status.error_code()]++;
+    last_error = status.error_message();
+  }
+
+  void merge(const Result &other)
+  {
+    requests += other.requests;
+    notifications += other.notifications;
+    updates += other.updates;
+    bytes += other.bytes;
+    for (auto &err : other.errors)
+      errors[err.first] += err.second;
+    if (!other.last_error.empty())
+      last_error = other.last_error;
+    latency.insert(latency.end(), other.latency.begin(), other.latency.end());
+    delay.insert(delay.end(), other.delay.begin(), other.delay.end());
+    jitter.insert(jitter.end(), other.jitter.begin(), other.jitter.end());
+  }
+};
+
+static string read_file(const string &path)
+{
+  ifstream ifs(path);
+  stringstream ss;
+
+  if (!ifs) {
+    cerr << "Can not read " << path << endl;
+    exit(1);
+  }
+  ss << ifs.rdbuf();
+
+  return ss.str();
+}
+
+static shared_ptr<grpc::Channel> make_channel(const Config &cfg, int id)
+{
+  shared_ptr<grpc::ChannelCredentials> creds;
+  grpc::ChannelArguments args;
+
+  /* Channels with equal arguments share their connection */
+  args.SetInt(LOAD_CHANNEL_ARG, id);
+
+  if (cfg.ca.empty()) {
+    creds = grpc::InsecureChannelCredentials();
+  } else {
+    grpc::SslCredentialsOptions opts;
+    opts.pem_root_certs = read_file(cfg.ca);
+    if (!cfg.cert.empty())
+      opts.pem_cert_chain = read_file(cfg.cert);
+    if (!cfg.key.empty())
+      opts.pem_private_key = read_file(cfg.key);
+    creds = grpc::SslCredentials(opts);
+    if (!cfg.tls_name.empty())
+      args.SetSslTargetNameOverride(cfg.tls_name);
+  }
+
+  return grpc::CreateCustomChannel(cfg.target, creds, args);
+}
+
+static void authenticate(const Config &cfg, ClientContext *ctx)
+{
+  if (!cfg.username.empty()) {
+    ctx->AddMetadata("username", cfg.username);
+    ctx->AddMetadata("password", cfg.password);
+  }
+}
+
+static int64_t elapsed_ns(steady_clock::time_point start)
+{
+  return duration_cast<nanoseconds>(steady_clock::now() - start).count();
+}
+
+/*
+ * Schedule of requests of one worker.
+ * In closed loop, next() returns the current time. At a fixed rate, it waits
+ * for the next slot and returns it; workers start at different offsets so
+ * that their requests are spread over the period.
+ */
+class Pacer {
+  public:
+    Pacer(const Config &cfg, int id)
+      : period(cfg.rate > 0 ? nanoseconds(static_cast<int64_t>(
+                                  1e9 * cfg.workers / cfg.rate))
+                            : nanoseconds(0)),
+        slot(steady_clock::now() + period * id / cfg.workers) {}
+
+    steady_clock::time_point next()
+    {
+      if (period.count() == 0)
+        return steady_clock::now();
+
+      steady_clock::time_point current = slot;
+      slot += period;
+      this_thread::sleep_until(current);
+      return current;
+    }
+
+  private:
+    nanoseconds period;
+    steady_clock::time_point slot;
+};
+
+static void count_updates(const Notification &notif, Result *res)
+{
+  res->notifications++;
+  res->updates += notif.update_size() + notif.delete__size();
+}
+
+static void run_get(const Config &cfg, gNMI::Stub *stub, int id, Result *res)
+{
+  Pacer pacer(cfg, id);
+  GetRequest request;
+
+  request.set_encoding(JSON_IETF);
+  for (auto &path : cfg.paths)
+    request.add_path()->CopyFrom(path);
+
+  while (steady_clock::now() < cfg.end) {
+    ClientContext ctx;
+    GetResponse response;
+
+    authenticate(cfg, &ctx);
+    steady_clock::time_point start = pacer.next();
+    Status status = stub->Get(&ctx, request, &response);
+    res->latency.push_back(elapsed_ns(start));
+
+    if (!status.ok()) {
+      res->error(status);
+      continue;
+    }
+    res->requests++;
+    res->bytes += response.ByteSizeLong();
+    for (auto &notif : response.notification())
+      count_updates(notif, res);
+  }
+}
+
+static void run_set(const Config &cfg, gNMI::Stub *stub, int id, Result *res)
+{
+  Pacer pacer(cfg, id);
+  SetRequest request;
+
+  for (auto &path : cfg.paths) {
+    Update *update = request.add_update();
+    update->mutable_path()->CopyFrom(path);
+    update->mutable_val()->set_json_ietf_val(cfg.value);
+  }
+
+  while (steady_clock::now() < cfg.end) {
+    ClientContext ctx;
+    SetResponse response;
+
+    authenticate(cfg, &ctx);
+    steady_clock::time_point start = pacer.next();
+    Status status = stub->Set(&ctx, request, &response);
+    res->latency.push_back(elapsed_ns(start));
+
+    if (!status.ok()) {
+      res->error(status);
+      continue;
+    }
+    res->requests++;
+    res->updates += response.response_size();
+    res->bytes += response.ByteSizeLong();
+  }
+}
+
+static SubscribeRequest subscription(const Config &cfg,
+                                     SubscriptionList::Mode mode)
+{
+  SubscribeRequest request;
+  SubscriptionList *list = request.mutable_subscribe();
+
+  list->set_mode(mode);
+  list->set_encoding(JSON_IETF);
+  for (auto &path : cfg.paths) {
+    Subscription *sub = list->add_subscription();
+    sub->mutable_path()->CopyFrom(path);
+    sub->set_mode(SAMPLE);
+    sub->set_sample_interval(cfg.interval * 1000000);
+  }
+
+  return request;
+}
+
+/* One STREAM subscription held until the end of the run */
+static void run_stream(const Config &cfg, gNMI::Stub *stub, int, Result *res)
+{
+  SubscribeRequest request = subscription(cfg, SubscriptionList::STREAM);
+  int64_t interval = cfg.interval * 1000000;
+  steady_clock::time_point start = steady_clock::now(), last;
+  SubscribeResponse response;
+  ClientContext ctx;
+  bool synced = false;
+
+  authenticate(cfg, &ctx);
+  ctx.set_deadline(system_clock::now()
+                   + duration_cast<system_clock::duration>(
+                       cfg.end - steady_clock::now()));
+
+  auto stream = stub->Subscribe(&ctx);
+  if (!stream->Write(request)) {
+    res->error(stream->Finish());
+    return;
+  }
+
+  while (stream->Read(&response)) {
+    steady_clock::time_point now = steady_clock::now();
+    int64_t received = get_time_nanosec();
+
+    res->bytes += response.ByteSizeLong();
+    if (response.sync_response()) {
+      synced = true;
+      res->requests++;
+      res->latency.push_back(duration_cast<nanoseconds>(now - start).count());
+      continue;
+    }
+    if (!response.has_update())
+      continue;
+
+    count_updates(response.update(), res);
+    if (!synced)
+      continue;
+
+    /* Notifications of one sample, one per path, arrive back to back */
+    res->delay.push_back(received
+                         - static_cast<int64_t>(response.update().timestamp()));
+    if (last != steady_clock::time_point()) {
+      int64_t measured = duration_cast<nanoseconds>(now - last).count();
+      if (measured < interval / 2)
+        continue;
+      res->jitter.push_back(llabs(measured - interval));
+    }
+    last = now;
+  }
+
+  Status status = stream->Finish();
+  if (status.error_code() != grpc::StatusCode::DEADLINE_EXCEEDED)
+    res->error(status);
+}
+
+/* ONCE subscriptions one after the other */
+static void run_once(const Config &cfg, gNMI::Stub *stub, int id, Result *res)
+{
+  SubscribeRequest request = subscription(cfg, SubscriptionList::ONCE);
+  Pacer pacer(cfg, id);
+
+  while (steady_clock::now() < cfg.end) {
+    SubscribeResponse response;
+    ClientContext ctx;
+    bool synced = false;
+
+    authenticate(cfg, &ctx);
+    steady_clock::time_point start = pacer.next();
+    auto stream = stub->Subscribe(&ctx);
+    if (stream->Write(request)) {
+      stream->WritesDone();
+      while (stream->Read(&response)) {
+        res->bytes += response.ByteSizeLong();
+        if (response.has_update())
+          count_updates(response.update(), res);
+        if (response.sync_response()) {
+          synced = true;
+          res->latency.push_back(elapsed_ns(start));
+        }
+      }
+    }
+
+    Status status = stream->Finish();
+    if (!status.ok())
+      res->error(status);
+    else if (synced)
+      res->requests++;
+  }
+}
+
+/* One POLL subscription, polled until the end of the run */
+static void run_poll(const Config &cfg, gNMI::Stub *stub, int id, Result *res)
+{
+  SubscribeRequest request = subscription(cfg, SubscriptionList::POLL);
+  SubscribeRequest poll;
+  SubscribeResponse response;
+  Pacer pacer(cfg, id);
+  ClientContext ctx;
+  bool synced;
+
+  poll.mutable_poll();
+  authenticate(cfg, &ctx);
+
+  auto stream = stub->Subscribe(&ctx);
+  if (!stream->Write(request)) {
+    res->error(stream->Finish());
+    return;
+  }
+
+  while (steady_clock::now() < cfg.end) {
+    steady_clock::time_point start = pacer.next();
+    if (!stream->Write(poll))
+      break;
+
+    /* A poll is answered once its sync_response is received, large samples
+     * are split in several Notifications */
+    synced = false;
+    while (!synced && stream->Read(&response)) {
+      res->bytes += response.ByteSizeLong();
+      if (response.has_update())
+        count_updates(response.update(), res);
+      synced = response.sync_response();
+    }
+    if (!synced)
+      break;
+    res->latency.push_back(elapsed_ns(start));
+    res->requests++;
+  }
+
+  stream->WritesDone();
+  Status status = stream->Finish();
+  if (!status.ok())
+    res->error(status);
+}
+
+/* Percentile of sorted samples, nearest rank */
+static int64_t percentile(const vector<int64_t> &sorted, double p)
+{
+  size_t rank;
+
+  if (sorted.empty())
+    return 0;
+
+  rank = static_cast<size_t>(p * sorted.size());
+  return sorted[min(rank, sorted.size() - 1)];
+}
+
+static void print_distribution(const string &name, vector<int64_t> &samples)
+{
+  if (samples.empty())
+    return;
+
+  sort(samples.begin(), samples.end());
+  cout << "  " << left << setw(14) << name + " (us)" << right
+       << " p50 " << setw(9) << percentile(samples, 0.5) / 1000
+       << "  p99 " << setw(9) << percentile(samples, 0.99) / 1000
+       << "  p999 " << setw(9) << percentile(samples, 0.999) / 1000
+       << "  max " << setw(9) << samples.back() / 1000
+       << "  (" << samples.size() << " samples)" << endl;
+}
+
+static void print_count(const string &name, uint64_t count, double seconds)
+{
+  cout << "  " << left << setw(14) << name << right << setw(12) << count
+       << setw(14) << fixed << setprecision(1) << count / seconds << "/s"
+       << endl;
+}
+
+static void report(const Config &cfg, Result &res, double seconds)
+{
+  static const char *modes[] = {"get", "set", "stream", "once", "poll"};
+  uint64_t errors = 0;
+
+  cout << "gnxi_load: " << modes[cfg.mode] << " on " << cfg.target << ", "
+       << cfg.workers << " workers over " << cfg.channels << " channels, "
+       << fixed << setprecision(1) << seconds << " s" << endl;
+
+  print_count(cfg.mode == STREAM ? "syncs" : "requests", res.requests,
+              seconds);
+  print_count("notifications", res.notifications, seconds);
+  print_count("updates", res.updates, seconds);
+  print_count("bytes", res.bytes, seconds);
+
+  for (auto &err : res.errors)
+    errors += err.second;
+  cout << "  " << left << setw(14) << "errors" << right << setw(12) << errors;
+  for (auto &err : res.errors)
+    cout << "  code " << err.first << ": " << err.second;
+  cout << endl;
+  if (!res.last_error.empty())
+    cout << "  last error: " << res.last_error << endl;
+
+  print_distribution("latency", res.latency);
+  print_distribution("delay", res.delay);
+  print_distribution("jitter", res.jitter);
+}
+
+static void show_usage(string name)
+{
+  cerr << "Usage: " << name << " <option(s)>\n"
+    << "Options:\n"
+    << "\t-h,--help\t\t\tShow this help message\n"
+    << "\t-t,--target HOST:PORT\t\tServer address (localhost:50051)\n"
+    << "\t-u,--username USERNAME\t\tConnection username\n"
+    << "\t-p,--password PASSWORD\t\tConnection password\n"
+    << "\t-r,--ca CERTIFICATE\t\tCA certificate, insecure connection if unset\n"
+    << "\t-c,--cert CERTIFICATE\t\tClient certificate, for mutual TLS\n"
+    << "\t-k,--private-key PRIVATE_KEY\tClient private key, for mutual TLS\n"
+    << "\t--tls-name NAME\t\t\tExpected server name in its certificate\n"
+    << "\t-m,--mode MODE\t\t\tWorkload (get)\n"
+    << "\t\t MODE = get, set, stream, once, poll\n"
+    << "\t-x,--path XPATH\t\t\tRequested path, can be repeated\n"
+    << "\t-v,--value JSON\t\t\tJSON IETF value written by set\n"
+    << "\t-n,--workers N\t\t\tConcurrent RPC loops or streams (1)\n"
+    << "\t--channels N\t\t\tConnections shared by workers (1)\n"
+    << "\t-d,--duration SECONDS\t\tDuration of the run (10)\n"
+    << "\t--rate N\t\t\tRequests per second of all workers, get, set,\n"
+    << "\t\t once and poll (0 = as fast as possible)\n"
+    << "\t-i,--interval MS\t\tSample interval of stream (1000)\n"
+    << endl;
+}
+
+/* Long options without short option character */
+enum {
+  OPT_TLS_NAME = 256,
+  OPT_CHANNELS,
+  OPT_RATE,
+};
+
+/* Parse a positive number given to option name, exit if it is invalid */
+static double parse_number(const char *name, const char *arg)
+{
+  char *end = nullptr;
+  double val;
+
+  errno = 0;
+  val = strtod(arg, &end);
+  if (errno != 0 || end == arg || *end != '\0' || val < 0) {
+    cerr << "Invalid value " << arg << " for --" << name << endl;
+    exit(1);
+  }
+
+  return val;
+}
+
+int main(int argc, char* argv[])
+{
+  int c;
+  int option_index = 0;
+  Config cfg;
+  string mode;
+  PathCompiler compiler(0);
+  vector<shared_ptr<grpc::Channel>> channels;
+  vector<unique_ptr<gNMI::Stub>> stubs;
+  vector<Result> results;
+  vector<thread> workers;
+  Result total;
+
+  static struct option long_options[] =
+  {
+    {"help", no_argument, 0, 'h'},
+    {"target", required_argument, 0, 't'},
+    {"username", required_argument, 0, 'u'},
+    {"password", required_argument, 0, 'p'},
+    {"ca", required_argument, 0, 'r'},
+    {"cert", required_argument, 0, 'c'},
+    {"private-key", required_argument, 0, 'k'},
+    {"tls-name", required_argument, 0, OPT_TLS_NAME},
+    {"mode", required_argument, 0, 'm'},
+    {"path", required_argument, 0, 'x'},
+    {"value", required_argument, 0, 'v'},
+    {"workers", required_argument, 0, 'n'},
+    {"channels", required_argument, 0, OPT_CHANNELS},
+    {"duration", required_argument, 0, 'd'},
+    {"rate", required_argument, 0, OPT_RATE},
+    {"interval", required_argument, 0, 'i'},
+    {0, 0, 0, 0}
+  };
+
+  while ((c = getopt_long(argc, argv, "ht:u:p:r:c:k:m:x:v:n:d:i:",
+                          long_options, &option_index)) != -1) {
+    switch (c)
+    {
+      case '?':
+      case 'h':
+        show_usage(argv[0]);
+        exit(0);
+        break;
+      case 't':
+        cfg.target = optarg;
+        break;
+      case 'u':
+        cfg.username = optarg;
+        break;
+      case 'p':
+        cfg.password = optarg;
+        break;
+      case 'r':
+        cfg.ca = optarg;
+        break;
+      case 'c':
+        cfg.cert = optarg;
+        break;
+      case 'k':
+        cfg.key = optarg;
+        break;
+      case OPT_TLS_NAME:
+        cfg.tls_name = optarg;
+        break;
+      case 'm':
+        mode = optarg;
+        break;
+      case 'x':
+        cfg.xpaths.push_back(optarg);
+        break;
+      case 'v':
+        cfg.value = optarg;
+        break;
+      case 'n':
+        cfg.workers = static_cast<int>(parse_number("workers", optarg));
+        break;
+      case OPT_CHANNELS:
+        cfg.channels = static_cast<int>(parse_number("channels", optarg));
+        break;
+      case 'd':
+        cfg.duration = parse_number("duration", optarg);
+        break;
+      case OPT_RATE:
+        cfg.rate = parse_number("rate", optarg);
+        break;
+      case 'i':
+        cfg.interval = static_cast<uint64_t>(parse_number("interval", optarg));
+        break;
+    }
+  }
+
+  if (mode.empty() || mode == "get") {
+    cfg.mode = GET;
+  } else if (mode == "set") {
+    cfg.mode = SET;
+  } else if (mode == "stream") {
+    cfg.mode = STREAM;
+  } else if (mode == "once") {
+    cfg.mode = ONCE;
+  } else if (mode == "poll") {
+    cfg.mode = POLL;
+  } else {
+    cerr << "Unknown mode " << mode << endl;
+    exit(1);
+  }
+
+  if (cfg.workers < 1 || cfg.channels < 1 || cfg.interval < 1) {
+    cerr << "workers, channels and interval must be at least 1" << endl;
+    exit(1);
+  }
+  if (cfg.xpaths.empty()) {
+    cerr << "At least one --path is required" << endl;
+    exit(1);
+  }
+  if (cfg.mode == SET && cfg.value.empty()) {
+    cerr << "set requires a --value" << endl;
+    exit(1);
+  }
+
+  /* ORIGIN:/xpath, as with gnmic, or /module:node/xpath */
+  for (auto &xpath : cfg.xpaths) {
+    Path path;
+    size_t sep = xpath.find(":/");
+    try {
+      if (sep != string::npos && xpath.find('/') > sep) {
+        compiler.parse(xpath.substr(sep + 1), &path);
+        path.set_origin(xpath.substr(0, sep));
+      } else {
+        compiler.parse(xpath, &path);
+      }
+    } catch (invalid_argument &exc) {
+      cerr << exc.what() << endl;
+      exit(1);
+    }
+    cfg.paths.push_back(path);
+  }
+
+  for (int i = 0; i < cfg.channels; i++) {
+    channels.push_back(make_channel(cfg, i));
+    stubs.push_back(gNMI::NewStub(channels.back()));
+  }
+
+  /* Connections are established before the clock starts */
+  for (auto &channel : channels) {
+    if (!channel->WaitForConnected(system_clock::now() + seconds(5))) {
+      cerr << "Failed to connect to " << cfg.target << endl;
+      exit(1);
+    }
+  }
+
+  results.resize(cfg.workers);
+  steady_clock::time_point start = steady_clock::now();
+  cfg.end = start + duration_cast<steady_clock::duration>(
+                        duration<double>(cfg.duration));
+
+  for (int i = 0; i < cfg.workers; i++) {
+    void (*run)(const Config&, gNMI::Stub*, int, Result*) = nullptr;
+    switch (cfg.mode) {
+      case GET: run = run_get; break;
+      case SET: run = run_set; break;
+      case STREAM: run = run_stream; break;
+      case ONCE: run = run_once; break;
+      case POLL: run = run_poll; break;
+    }
+    workers.emplace_back(run, cref(cfg), stubs[i % cfg.channels].get(), i,
+                         &results[i]);
+  }
+
+  for (auto &worker : workers)
+    worker.join();
+
+  for (auto &res : results)
+    total.merge(res);
+  report(cfg, total,
+         duration_cast<duration<double>>(steady_clock::now() - start).count());
+
+  return total.errors.empty() ? 0 : 2;
+}
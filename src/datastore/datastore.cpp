@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <utils/log.h>
+
+#include "datastore.h"
+#include "memory_store.h"
+#include "sysrepo_store.h"
+
+using namespace std;
+
+#define MEMORY_PREFIX "memory:"
+
+shared_ptr<Datastore> Datastore::open(const string &uri)
+{
+  if (uri.empty() || uri == "sysrepo")
+    return make_shared<SysrepoDatastore>("gnmi");
+
+  if (uri.compare(0, strlen(MEMORY_PREFIX), MEMORY_PREFIX) == 0)
+    return make_shared<MemoryDatastore>(uri.substr(strlen(MEMORY_PREFIX)));
+
+  throw runtime_error("Unknown datastore " + uri);
+}
+
+void Datastore::fetch(vector<YangModule> &mods)
+{
+  for (auto &mod : mods) {
+    try {
+      mod.text = schema(mod.name, mod.revision);
+    } catch (const exception &exc) {
+      GNXI_LOG(ENCODE, warning) << exc.what();
+    }
+  }
+}
+
+string Datastore::page(const string &xpath, uint64_t offset, uint64_t limit)
+{
+  if (offset == 0 && limit == 0)
+    return xpath;
+  if (limit == 0 || limit > UINT64_MAX - offset)
+    return xpath + "[position()>" + to_string(offset) + "]";
+
+  return xpath + "[position()>" + to_string(offset)
+               + " and position()<=" + to_string(offset + limit) + "]";
+}
+
+void Datastore::iterate(const string &xpath,
+                        const function<bool(DataTree&)> &sink, size_t)
+{
+  for (auto &tree : read(xpath))
+    if (!sink(tree))
+      return;
+}
+
+Transaction::~Transaction()
+{
+  if (committed)
+    return;
+
+  try {
+    datastore->discard();
+  } catch (const exception &exc) {
+    GNXI_LOG(ENCODE, error) << "Fail discarding changes: " << exc.what();
+  }
+}
+
+void Transaction::commit()
+{
+  datastore->commit();
+  committed = true;
+}
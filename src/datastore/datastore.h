@@ -0,0 +1,139 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _DATASTORE_H
+#define _DATASTORE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <jsoncpp/json/json.h>
+
+/* YANG module implemented by a datastore */
+struct YangModule {
+  std::string name;
+  std::string revision; //empty if module has no revision
+  std::vector<std::string> features; //enabled features
+  std::string text; //YANG format, only filled by Datastore::fetch()
+};
+
+/* Default number of subtrees held in memory by Datastore::iterate */
+#define READ_BATCH_SIZE 1024
+
+/* Subtree read from a datastore */
+struct DataTree {
+  std::string xpath; //absolute xpath of the subtree root, can be empty
+  std::pair<std::string, std::string> key; //first key of a list entry
+  Json::Value value; //children of the root, in the JSON data model
+};
+
+/*
+ * Datastore - YANG datastore read and modified by the gNMI RPCs.
+ *
+ * Changes made with set() and remove() are private to the datastore object
+ * until commit(), readers only see committed data. Writers sharing a
+ * datastore make their changes in a Transaction.
+ * Methods throw invalid_argument on a wrong xpath or value, and
+ * runtime_error on a failure of the datastore.
+ */
+class Datastore {
+  public:
+    /* Schema changes notified by the datastore */
+    class Listener {
+      public:
+        virtual ~Listener() {}
+        virtual void install(const std::string &module,
+                             const std::string &revision) = 0;
+        virtual void feature(const std::string &module,
+                             const std::string &feature, bool enable) = 0;
+    };
+
+    virtual ~Datastore() {}
+
+    /*
+     * Open a datastore
+     * @param uri "sysrepo", or "memory:DIR" for an in-memory datastore of
+     *            the YANG modules and JSON data files of DIR
+     * @throw runtime_error if datastore can not be opened
+     */
+    static std::shared_ptr<Datastore> open(const std::string &uri);
+
+    /* Select list entries offset+1 to offset+limit of xpath, in datastore
+     * order, limit 0 selects all entries after offset. Pages read by
+     * separate reads are not consistent: entries created or deleted in
+     * between shift the next pages. */
+    static std::string page(const std::string &xpath, uint64_t offset,
+                            uint64_t limit);
+
+    /* Schemas */
+    virtual std::vector<YangModule> modules() = 0;
+    virtual std::string schema(const std::string &module,
+                               const std::string &revision) = 0;
+    /* Download text of modules, modules failing are left with empty text */
+    virtual void fetch(std::vector<YangModule> &mods);
+    /* Listener is notified of changes until the datastore is destroyed */
+    virtual void subscribe(std::shared_ptr<Listener> listener) = 0;
+
+    /* Data */
+    virtual void refresh() {} //see data committed by others
+    /* Subtrees matching xpath, throw invalid_argument if there is none */
+    virtual std::vector<DataTree> read(const std::string &xpath) = 0;
+    /*
+     * Same as read, subtrees are passed to sink one at a time, from one
+     * snapshot of the data, sink returns false to stop. Backends hold at
+     * most batch subtrees in memory, the default reads all of them with
+     * read().
+     */
+    virtual void iterate(const std::string &xpath,
+                         const std::function<bool(DataTree&)> &sink,
+                         size_t batch = READ_BATCH_SIZE);
+    /* Set a leaf, value is nullptr for list entries and empty leaves */
+    virtual void set(const std::string &xpath, const char *value) = 0;
+    virtual void remove(const std::string &xpath) = 0;
+    virtual void commit() = 0;
+    virtual void discard() = 0;
+
+  private:
+    friend class Transaction;
+    std::mutex transaction_lock; //held by the running Transaction
+};
+
+/*
+ * Transaction - Changes of one writer, like a Set RPC. Transactions of a
+ * datastore run one at a time, from their creation to their destruction,
+ * so that a writer never commits changes of another one. Changes not
+ * committed are discarded on destruction, e.g. when a change fails.
+ */
+class Transaction {
+  public:
+    Transaction(std::shared_ptr<Datastore> store)
+      : datastore(store), lock(store->transaction_lock), committed(false) {}
+    ~Transaction();
+
+    void commit();
+
+  private:
+    std::shared_ptr<Datastore> datastore;
+    std::lock_guard<std::mutex> lock;
+    bool committed;
+};
+
+#endif //_DATASTORE_H
@@ -0,0 +1,378 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <dirent.h>
+
+#include <libyang/Tree_Schema.hpp>
+
+#include <utils/log.h>
+
+#include "memory_store.h"
+
+using namespace std;
+using namespace libyang;
+
+static string read_file(const string &path)
+{
+  ifstream ifs(path);
+  stringstream ss;
+
+  if (!ifs)
+    throw runtime_error("Can not read " + path);
+  ss << ifs.rdbuf();
+
+  return ss.str();
+}
+
+/* Sorted names of files of dir ending with suffix */
+static vector<string> list_files(const string &dir, const string &suffix)
+{
+  vector<string> files;
+  DIR *dp = opendir(dir.c_str());
+  struct dirent *entry;
+
+  if (dp == nullptr)
+    throw runtime_error("Can not open directory " + dir);
+
+  while ((entry = readdir(dp)) != nullptr) {
+    string name = entry->d_name;
+    if (name.size() > suffix.size()
+        && name.compare(name.size() - suffix.size(), suffix.size(),
+                        suffix) == 0)
+      files.push_back(name);
+  }
+  closedir(dp);
+
+  sort(files.begin(), files.end());
+  return files;
+}
+
+MemoryDatastore::MemoryDatastore(const string &dir)
+  : ctx(make_shared<Context>(dir.c_str())), running(make_shared<Trees>())
+{
+  auto trees = make_shared<Trees>();
+
+  /* MODULE[@REVISION].yang, imports are resolved from the same directory */
+  for (auto &file : list_files(dir, ".yang")) {
+    string name = file.substr(0, min(file.find('@'), file.rfind('.')));
+
+    texts[name] = read_file(dir + "/" + file);
+    if (ctx->get_module(name.c_str()) != nullptr)
+      continue; //already imported by another module
+
+    try {
+      ctx->parse_module_mem(texts[name].c_str(), LYS_IN_YANG);
+    } catch (const exception &exc) {
+      throw runtime_error("Can not load " + file + ": " + exc.what());
+    }
+  }
+
+  /* Every module of the directory is implemented, with all its features */
+  for (auto &text : texts) {
+    S_Module mod = ctx->get_module(text.first.c_str());
+    YangModule info;
+
+    if (mod == nullptr)
+      continue; //submodule
+    if (!mod->implemented())
+      lys_set_implemented(mod->swig_module());
+    mod->feature_enable("*");
+
+    info.name = mod->name();
+    if (mod->rev_size() > 0)
+      info.revision = mod->rev()->date();
+    info.features.push_back("*");
+    mods.push_back(info);
+  }
+
+  /* Data files, top-level nodes are split in independent trees */
+  for (auto &file : list_files(dir, ".json")) {
+    S_Data_Node data;
+
+    try {
+      data = ctx->parse_data_mem(read_file(dir + "/" + file).c_str(),
+                                 LYD_JSON, LYD_OPT_DATA | LYD_OPT_TRUSTED
+                                           | LYD_OPT_STRICT
+                                           | LYD_OPT_DATA_NO_YANGLIB);
+    } catch (const exception &exc) {
+      throw runtime_error("Can not load " + file + ": " + exc.what());
+    }
+
+    for (S_Data_Node top = data; top != nullptr; top = top->next())
+      (*trees)[top->path()] = top->dup(1);
+  }
+  running = trees;
+
+  GNXI_LOG(ENCODE, info) << "Memory datastore loaded " << mods.size()
+                         << " modules and " << trees->size()
+                         << " top-level nodes from " << dir;
+}
+
+string MemoryDatastore::schema(const string &module, const string &)
+{
+  auto it = texts.find(module);
+
+  if (it == texts.end())
+    throw runtime_error("Unknown module " + module);
+
+  return it->second;
+}
+
+/********
+ * READ *
+ ********/
+
+/* Leaf value, numbers follow the same RFC 7951 mapping as sysrepo trees */
+static Json::Value json_leaf(S_Data_Node node)
+{
+  S_Data_Node_Leaf_List leaf = make_shared<Data_Node_Leaf_List>(node);
+  const char *str = leaf->value_str();
+
+  switch (leaf->value_type()) {
+    case LY_TYPE_INT8:
+    case LY_TYPE_INT16:
+    case LY_TYPE_INT32:
+      return Json::Value(static_cast<Json::Int>(strtol(str, nullptr, 10)));
+    case LY_TYPE_UINT8:
+    case LY_TYPE_UINT16:
+    case LY_TYPE_UINT32:
+      return Json::Value(static_cast<Json::UInt>(strtoul(str, nullptr, 10)));
+    case LY_TYPE_EMPTY:
+      return Json::Value("null");
+    default: //JSON strings
+      return Json::Value(str ? str : "");
+  }
+}
+
+static Json::Value json_tree(S_Data_Node node)
+{
+  Json::Value val;
+
+  for (S_Data_Node iter = node->child(); iter != nullptr;
+       iter = iter->next()) {
+    const char *name = iter->schema()->name();
+
+    switch (iter->schema()->nodetype()) {
+      case LYS_LEAF:
+        if (make_shared<Data_Node_Leaf_List>(iter)->value_type()
+            == LY_TYPE_EMPTY)
+          val[name].append(json_leaf(iter));
+        else
+          val[name] = json_leaf(iter);
+        break;
+
+      /* JSON arrays */
+      case LYS_LEAFLIST:
+        val[name].append(json_leaf(iter));
+        break;
+      case LYS_LIST:
+        val[name].append(json_tree(iter));
+        break;
+
+      /* nested JSON */
+      case LYS_CONTAINER:
+        val[name] = json_tree(iter);
+        break;
+
+      default:
+        throw invalid_argument("unsupported ANYDATA and ANYXML types");
+    }
+  }
+
+  return val;
+}
+
+vector<DataTree> MemoryDatastore::read(const string &xpath)
+{
+  vector<DataTree> trees;
+
+  iterate(xpath, [&trees](DataTree &tree) {
+    trees.push_back(std::move(tree));
+    return true;
+  });
+
+  return trees;
+}
+
+void MemoryDatastore::iterate(const string &xpath,
+                              const function<bool(DataTree&)> &sink, size_t)
+{
+  shared_ptr<const Trees> snapshot = atomic_load(&running); //pinned
+  bool found_any = false;
+
+  for (auto &top : *snapshot) {
+    S_Set found = top.second->find_path(xpath.c_str());
+
+    if (found == nullptr)
+      throw invalid_argument("Invalid xpath " + xpath);
+
+    for (auto &node : found->data()) {
+      DataTree tree;
+
+      tree.xpath = node->path();
+      tree.value = json_tree(node);
+
+      /* keys are always first children of list entries */
+      if (node->schema()->nodetype() == LYS_LIST && node->child()) {
+        tree.key.first = node->child()->schema()->name();
+        tree.key.second = tree.value[tree.key.first].asString();
+      }
+
+      found_any = true;
+      if (!sink(tree))
+        return;
+    }
+  }
+
+  if (!found_any)
+    throw invalid_argument("xpath not found");
+}
+
+/*********
+ * WRITE *
+ *********/
+
+/* Uncommitted data, created on first change */
+MemoryDatastore::Trees& MemoryDatastore::edited()
+{
+  if (candidate == nullptr)
+    candidate = make_shared<Trees>(*atomic_load(&running));
+
+  return *candidate;
+}
+
+/* Tree top of candidate, copied first if it is shared with running */
+S_Data_Node MemoryDatastore::copy(Trees &trees, const string &top)
+{
+  S_Data_Node &tree = trees[top];
+
+  if (copied.insert(top).second)
+    tree = tree->dup(1);
+
+  return tree;
+}
+
+/* First step of an absolute xpath, predicates included */
+static string top_step(const string &xpath)
+{
+  char quote = 0;
+
+  for (size_t i = 1; i < xpath.size(); i++) {
+    if (quote) {
+      if (xpath[i] == quote)
+        quote = 0;
+    } else if (xpath[i] == '\'' || xpath[i] == '"') {
+      quote = xpath[i];
+    } else if (xpath[i] == '/') {
+      return xpath.substr(0, i);
+    }
+  }
+
+  return xpath;
+}
+
+void MemoryDatastore::set(const string &xpath, const char *value)
+{
+  lock_guard<mutex> lock(writer);
+  Trees &trees = edited();
+  string step = top_step(xpath);
+  S_Data_Node root;
+
+  try {
+    for (auto &top : trees) {
+      S_Set found = top.second->find_path(step.c_str());
+      if (found != nullptr && !found->data().empty()) {
+        root = copy(trees, top.first);
+        break;
+      }
+    }
+
+    if (root == nullptr) {
+      root = make_shared<Data_Node>(ctx, xpath.c_str(), value,
+                                    LYD_ANYDATA_CONSTSTRING,
+                                    LYD_PATH_OPT_UPDATE);
+      trees[root->path()] = root;
+      copied.insert(root->path());
+      return;
+    }
+
+    /* nullptr if nothing was created or changed */
+    if (root->new_path(ctx, xpath.c_str(), value, LYD_ANYDATA_CONSTSTRING,
+                       LYD_PATH_OPT_UPDATE) == nullptr) {
+      S_Set found = root->find_path(xpath.c_str());
+      if (found == nullptr || found->data().empty())
+        throw invalid_argument("Can not set " + xpath);
+    }
+  } catch (const runtime_error &exc) { //libyang error, wrong path or value
+    throw invalid_argument(exc.what());
+  }
+}
+
+void MemoryDatastore::remove(const string &xpath)
+{
+  lock_guard<mutex> lock(writer);
+  Trees &trees = edited();
+  vector<string> emptied;
+
+  for (auto &top : trees) {
+    S_Set found = top.second->find_path(xpath.c_str());
+
+    if (found == nullptr)
+      throw invalid_argument("Invalid xpath " + xpath);
+    if (found->data().empty())
+      continue;
+
+    /* Nodes are removed from the copy */
+    found = copy(trees, top.first)->find_path(xpath.c_str());
+    for (auto &node : found->data()) {
+      if (node->parent() == nullptr)
+        emptied.push_back(top.first);
+      else
+        node->unlink();
+    }
+  }
+
+  for (auto &top : emptied) {
+    trees.erase(top);
+    copied.erase(top);
+  }
+}
+
+void MemoryDatastore::commit()
+{
+  lock_guard<mutex> lock(writer);
+
+  if (candidate == nullptr)
+    return;
+
+  atomic_store(&running, shared_ptr<const Trees>(candidate));
+  candidate = nullptr;
+  copied.clear();
+}
+
+void MemoryDatastore::discard()
+{
+  lock_guard<mutex> lock(writer);
+
+  candidate = nullptr;
+  copied.clear();
+}
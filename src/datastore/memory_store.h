@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MEMORY_STORE_H
+#define _MEMORY_STORE_H
+
+#include <map>
+#include <mutex>
+#include <set>
+
+#include <libyang/Libyang.hpp>
+#include <libyang/Tree_Data.hpp>
+
+#include "datastore.h"
+
+/*
+ * MemoryDatastore - datastore kept in libyang data trees, without sysrepo.
+ * It is meant for benchmarks and tests: schemas are fixed at startup, data
+ * is lost on exit and commits are not validated against must and leafref
+ * constraints.
+ *
+ * Committed data is published in a Read-Copy-Update fashion like the
+ * SchemaContext: readers pin a snapshot and never wait for writers. Changes
+ * are made on copies of the top-level trees they modify, published by
+ * commit().
+ */
+class MemoryDatastore : public Datastore {
+  public:
+    /*
+     * @param dir directory of YANG modules (*.yang) and data in JSON IETF
+     *            encoding (*.json) loaded at startup
+     * @throw runtime_error if a file can not be loaded
+     */
+    MemoryDatastore(const std::string &dir);
+    ~MemoryDatastore() {}
+
+    std::vector<YangModule> modules() override { return mods; }
+    std::string schema(const std::string &module,
+                       const std::string &revision) override;
+    void subscribe(std::shared_ptr<Listener>) override {} //schemas are fixed
+
+    std::vector<DataTree> read(const std::string &xpath) override;
+    /* Nodes are found in the snapshot at once, they are converted to the
+     * JSON data model one at a time: batch is not used */
+    void iterate(const std::string &xpath,
+                 const std::function<bool(DataTree&)> &sink,
+                 size_t batch = READ_BATCH_SIZE) override;
+    void set(const std::string &xpath, const char *value) override;
+    void remove(const std::string &xpath) override;
+    void commit() override;
+    void discard() override;
+
+  private:
+    /* Top-level nodes by xpath, every one is a tree without sibling */
+    typedef std::map<std::string, libyang::S_Data_Node> Trees;
+
+    Trees& edited();
+    libyang::S_Data_Node copy(Trees &trees, const std::string &top);
+
+  private:
+    libyang::S_Context ctx;
+    std::map<std::string, std::string> texts; //YANG modules by name
+    std::vector<YangModule> mods;
+
+    std::shared_ptr<const Trees> running; //published data
+    std::mutex writer; //serialize writers, protects candidate and copied
+    std::shared_ptr<Trees> candidate; //changes of the running Transaction
+    std::set<std::string> copied; //trees of candidate not shared with running
+};
+
+#endif //_MEMORY_STORE_H
@@ -0,0 +1,395 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include <sysrepo-cpp/Struct.hpp>
+#include <sysrepo-cpp/Sysrepo.hpp>
+
+#include <utils/log.h>
+
+#include "sysrepo_store.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/* Maximum number of sysrepo connections used to download schemas */
+#define MAX_LOADER_THREADS 8
+
+/* Forward sysrepo schema events to a datastore listener */
+class SysrepoCallback : public sysrepo::Callback {
+  public:
+    SysrepoCallback(shared_ptr<Datastore::Listener> listener)
+      : target(listener) {}
+
+    void module_install(const char *module_name, const char *revision,
+                        sr_module_state_t state, void *) override
+    {
+      switch (state) {
+        case SR_MS_UNINSTALLED:
+          GNXI_LOG(ENCODE, warning) << "Impossible to remove a module at "
+                                    << "runtime";
+          break;
+
+        case SR_MS_IMPORTED:
+        case SR_MS_IMPLEMENTED:
+          GNXI_LOG(ENCODE, info) << "Install " << module_name;
+          target->install(module_name, revision ? revision : "");
+          break;
+
+        default:
+          GNXI_LOG(ENCODE, error) << "Unknown state";
+      }
+    }
+
+    void feature_enable(const char *module_name, const char *feature_name,
+                        bool enable, void *) override
+    {
+      target->feature(module_name, feature_name, enable);
+    }
+
+  private:
+    shared_ptr<Datastore::Listener> target;
+};
+
+SysrepoDatastore::SysrepoDatastore(const string &app)
+{
+  sr_con = make_shared<sysrepo::Connection>(app.c_str(),
+                                            SR_CONN_DAEMON_REQUIRED);
+  sr_sess = make_shared<sysrepo::Session>(sr_con);
+}
+
+/***********
+ * SCHEMAS *
+ ***********/
+
+vector<YangModule> SysrepoDatastore::modules()
+{
+  sysrepo::S_Yang_Schemas schemas = sr_sess->list_schemas();
+  vector<YangModule> mods(schemas->schema_cnt());
+
+  for (size_t i = 0; i < schemas->schema_cnt(); i++) {
+    mods[i].name = schemas->schema(i)->module_name();
+    mods[i].revision = schemas->schema(i)->revision()->revision();
+    for (size_t j = 0; j < schemas->schema(i)->enabled_feature_cnt(); j++)
+      mods[i].features.push_back(schemas->schema(i)->enabled_features(j));
+  }
+
+  return mods;
+}
+
+string SysrepoDatastore::schema(const string &module, const string &revision)
+{
+  return sr_sess->get_schema(module.c_str(),
+                             revision.empty() ? nullptr : revision.c_str(),
+                             nullptr, SR_SCHEMA_YANG);
+}
+
+/* Download one schema in YANG format and measure the time spent doing it */
+static void fetch_module(sysrepo::S_Session sess, YangModule &mod)
+{
+  auto start = steady_clock::now();
+
+  try {
+    mod.text = sess->get_schema(mod.name.c_str(), mod.revision.c_str(), NULL,
+                                SR_SCHEMA_YANG);
+    GNXI_LOG(ENCODE, info) << "Downloaded " << mod.name << "@" << mod.revision
+                           << " in "
+                           << duration_cast<microseconds>(steady_clock::now()
+                                                          - start).count()
+                           << " us";
+  } catch (const exception &exc) {
+    GNXI_LOG(ENCODE, warning) << exc.what();
+  }
+}
+
+/*
+ * Download all schemas from sysrepo in parallel.
+ * Every worker uses its own sysrepo connection so requests are not serialized
+ * on the connection socket. Modules a worker could not download are fetched
+ * again with the main session.
+ */
+void SysrepoDatastore::fetch(vector<YangModule> &mods)
+{
+  atomic<size_t> next(0);
+  vector<thread> workers;
+  size_t nthreads = thread::hardware_concurrency();
+
+  if (nthreads == 0)
+    nthreads = 1;
+  nthreads = min<size_t>(min<size_t>(nthreads, MAX_LOADER_THREADS),
+                         mods.size());
+
+  for (size_t t = 0; t < nthreads; t++) {
+    workers.emplace_back([&mods, &next]() {
+      sysrepo::S_Connection conn;
+      sysrepo::S_Session wsess;
+
+      try {
+        conn = make_shared<sysrepo::Connection>("gnxi-loader",
+                                                SR_CONN_DAEMON_REQUIRED);
+        wsess = make_shared<sysrepo::Session>(conn);
+      } catch (const exception &exc) {
+        GNXI_LOG(ENCODE, warning) << "Loader connection failed " << exc.what();
+        return;
+      }
+
+      for (size_t i = next++; i < mods.size(); i = next++)
+        fetch_module(wsess, mods[i]);
+    });
+  }
+
+  for (auto &worker : workers)
+    worker.join();
+
+  /* Fallback on main session for modules workers did not download */
+  for (auto &mod : mods) {
+    if (mod.text.empty())
+      fetch_module(sr_sess, mod);
+  }
+}
+
+void SysrepoDatastore::subscribe(shared_ptr<Listener> listener)
+{
+  sysrepo::S_Callback callback = make_shared<SysrepoCallback>(listener);
+
+  if (sub == nullptr)
+    sub = make_shared<sysrepo::Subscribe>(sr_sess);
+  callbacks.push_back(callback);
+
+  /* notifications about new modules */
+  sub->module_install_subscribe(callback, nullptr, sysrepo::SUBSCR_DEFAULT);
+
+  /* changes of features state */
+  sub->feature_enable_subscribe(callback);
+}
+
+/********
+ * DATA *
+ ********/
+
+void SysrepoDatastore::refresh()
+{
+  sr_sess->refresh();
+}
+
+static Json::Value json_tree(sysrepo::S_Tree tree)
+{
+  sysrepo::S_Tree iter;
+  Json::Value val;
+
+  // run through all siblings
+  for (iter = tree->first_child(); iter != nullptr; iter = iter->next()) {
+    //create sibling with "node" as a parent
+    switch (iter->type()) { //follows RFC 7951
+      /* JSON Number */
+      case SR_UINT8_T:
+        val[iter->name()] = iter->data()->get_uint8();
+        break;
+      case SR_UINT16_T:
+        val[iter->name()] = iter->data()->get_uint16();
+        break;
+      case SR_UINT32_T:
+        val[iter->name()] = iter->data()->get_uint32();
+        break;
+      case SR_INT8_T:
+        val[iter->name()] = iter->data()->get_int8();
+        break;
+      case SR_INT16_T:
+        val[iter->name()] = iter->data()->get_int16();
+        break;
+      case SR_INT32_T:
+        val[iter->name()] = iter->data()->get_int32();
+        break;
+
+      /* JSON string */
+      case SR_STRING_T:
+        val[iter->name()] = iter->data()->get_string();
+        break;
+      case SR_INT64_T:
+        val[iter->name()] = to_string(iter->data()->get_int64());
+        break;
+      case SR_UINT64_T:
+        val[iter->name()] = to_string(iter->data()->get_uint64());
+        break;
+      case SR_DECIMAL64_T:
+        val[iter->name()] = to_string(iter->data()->get_decimal64());
+        break;
+      case SR_IDENTITYREF_T:
+        val[iter->name()] = iter->data()->get_identityref();
+        break;
+      case SR_INSTANCEID_T:
+        val[iter->name()] = iter->data()->get_identityref();
+        break;
+      case SR_BINARY_T:
+        val[iter->name()] = iter->data()->get_binary();
+        break;
+      case SR_BITS_T:
+        val[iter->name()] = iter->data()->get_bits();
+        break;
+      case SR_ENUM_T:
+        val[iter->name()] = iter->data()->get_enum();
+        break;
+      case SR_BOOL_T:
+        val[iter->name()] = iter->data()->get_bool() ? "true" : "false";
+        break;
+
+      /* JSON arrays */
+      case SR_LIST_T:
+        val[iter->name()].append(json_tree(iter));
+        break;
+      case SR_LEAF_EMPTY_T:
+        val[iter->name()].append("null");
+        break;
+
+      /* nested JSON */
+      case SR_CONTAINER_T:
+      case SR_CONTAINER_PRESENCE_T:
+        val[iter->name()] = json_tree(iter);
+        break;
+
+      /* Unsupported types */
+      case SR_ANYDATA_T:
+      case SR_ANYXML_T:
+        throw invalid_argument("unsupported ANYDATA and ANYXML types");
+        break;
+
+      default:
+        GNXI_LOG(ENCODE, error) << "Unknown tree node type";
+        throw invalid_argument("Unknown tree node type");
+      }
+  }
+  return val;
+}
+
+/* Convert a sysrepo tree to a DataTree, without its xpath */
+static void convert(sysrepo::S_Tree sr_tree, DataTree *tree)
+{
+  tree->value = json_tree(sr_tree);
+
+  /* keys are always first element of children in sysrepo trees */
+  if (sr_tree->type() == SR_LIST_T) {
+    tree->key.first = string(sr_tree->first_child()->name());
+    tree->key.second = tree->value[tree->key.first].asString();
+  }
+}
+
+/* Pass a sysrepo tree read at xpath to sink, skip it if it was deleted */
+static bool sink_tree(sysrepo::S_Tree sr_tree, const string &xpath,
+                      const function<bool(DataTree&)> &sink)
+{
+  DataTree tree;
+
+  if (sr_tree == nullptr)
+    return true;
+
+  convert(sr_tree, &tree);
+  tree.xpath = xpath;
+  return sink(tree);
+}
+
+vector<DataTree> SysrepoDatastore::read(const string &xpath)
+{
+  vector<DataTree> trees;
+
+  iterate(xpath, [&trees](DataTree &tree) {
+    trees.push_back(std::move(tree));
+    return true;
+  });
+
+  return trees;
+}
+
+void SysrepoDatastore::iterate(const string &xpath,
+                               const function<bool(DataTree&)> &sink,
+                               size_t batch)
+{
+  sysrepo::S_Iter_Value iter;
+  sysrepo::S_Trees sr_trees;
+  sysrepo::S_Val val;
+  vector<string> listed;
+
+  if (batch == 0)
+    batch = READ_BATCH_SIZE;
+
+  /* List up to batch items with their xpath, without reading subtrees:
+   * sysrepo trees do not carry their xpath */
+  iter = sr_sess->get_items_iter(xpath.c_str());
+  while (iter != nullptr && listed.size() <= batch
+         && (val = sr_sess->get_item_next(iter)) != nullptr)
+    listed.push_back(val->xpath());
+
+  if (listed.empty())
+    throw invalid_argument("xpath not found");
+
+  if (listed.size() <= batch) {
+    /* Subtrees are returned in the order items are listed, if the session
+     * was refreshed in between, read listed items one by one */
+    sr_trees = sr_sess->get_subtrees(xpath.c_str());
+    if (sr_trees != nullptr && sr_trees->tree_cnt() == listed.size()) {
+      for (size_t i = 0; i < listed.size(); i++)
+        if (!sink_tree(sr_trees->tree(i), listed[i], sink))
+          return;
+    } else {
+      for (auto &item : listed)
+        if (!sink_tree(sr_sess->get_subtree(item.c_str()), item, sink))
+          return;
+    }
+    return;
+  }
+
+  /*
+   * Read listed items one by one, then go on with the iterator, which lists
+   * the next items in chunks. Items come from the copy of the data loaded
+   * by the session, only reloaded by refresh().
+   */
+  GNXI_LOG(ENCODE, debug) << "Iterate over more than " << batch
+                          << " items of " << xpath;
+  for (auto &item : listed)
+    if (!sink_tree(sr_sess->get_subtree(item.c_str()), item, sink))
+      return;
+  listed.clear();
+
+  while ((val = sr_sess->get_item_next(iter)) != nullptr)
+    if (!sink_tree(sr_sess->get_subtree(val->xpath()), val->xpath(), sink))
+      return;
+}
+
+void SysrepoDatastore::set(const string &xpath, const char *value)
+{
+  if (value == nullptr)
+    sr_sess->set_item(xpath.c_str());
+  else
+    sr_sess->set_item_str(xpath.c_str(), value);
+}
+
+void SysrepoDatastore::remove(const string &xpath)
+{
+  sr_sess->delete_item(xpath.c_str()); //EDIT_DEFAULT option
+}
+
+void SysrepoDatastore::commit()
+{
+  sr_sess->commit();
+}
+
+void SysrepoDatastore::discard()
+{
+  sr_sess->discard_changes();
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SYSREPO_STORE_H
+#define _SYSREPO_STORE_H
+
+#include <sysrepo-cpp/Connection.hpp>
+#include <sysrepo-cpp/Session.hpp>
+
+#include "datastore.h"
+
+/*
+ * SysrepoDatastore - running datastore of the sysrepo daemon.
+ * Every RPC shares the same sysrepo session.
+ */
+class SysrepoDatastore : public Datastore {
+  public:
+    /* @throw runtime_error if sysrepo daemon is not reachable */
+    SysrepoDatastore(const std::string &app);
+    ~SysrepoDatastore() {}
+
+    std::vector<YangModule> modules() override;
+    std::string schema(const std::string &module,
+                       const std::string &revision) override;
+    void fetch(std::vector<YangModule> &mods) override;
+    void subscribe(std::shared_ptr<Listener> listener) override;
+
+    void refresh() override;
+    std::vector<DataTree> read(const std::string &xpath) override;
+    /* Items are listed once, trees are named after their listed xpath.
+     * Results of up to batch entries are read at once, larger ones are read
+     * entry by entry while they are listed */
+    void iterate(const std::string &xpath,
+                 const std::function<bool(DataTree&)> &sink,
+                 size_t batch = READ_BATCH_SIZE) override;
+    void set(const std::string &xpath, const char *value) override;
+    void remove(const std::string &xpath) override;
+    void commit() override;
+    void discard() override;
+
+  private:
+    sysrepo::S_Connection sr_con; //sysrepo connection
+    sysrepo::S_Session sr_sess; //sysrepo session
+    sysrepo::S_Subscribe sub; //must outlive callbacks to receive them
+    std::vector<sysrepo::S_Callback> callbacks;
+};
+
+#endif //_SYSREPO_STORE_H
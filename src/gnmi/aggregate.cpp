@@ -0,0 +1,326 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <utils/log.h>
+
+#include "aggregate.h"
+
+using namespace std;
+using gnxi_ext::Aggregation;
+
+Aggregator::Aggregator(const Aggregation &aggregation, KeyResolver resolver)
+  : window_ns(aggregation.window()), has_prefix(false), list_keys(resolver)
+{
+  bool all = aggregation.functions_size() == 0;
+
+  if (window_ns == 0 || window_ns > INT64_MAX)
+    throw invalid_argument(string("Aggregation window must be between 1 and ")
+                           + to_string(INT64_MAX) + " nanoseconds");
+
+  for (int function : aggregation.functions()) {
+    if (!Aggregation::Function_IsValid(function))
+      throw invalid_argument("Unknown aggregation function "
+                             + to_string(function));
+    if (function == Aggregation::ALL)
+      all = true;
+    else if (find(functions.begin(), functions.end(), function)
+             == functions.end())
+      functions.push_back(Aggregation::Function(function));
+  }
+
+  if (all)
+    functions = {Aggregation::MINIMUM, Aggregation::MAXIMUM,
+                 Aggregation::AVERAGE};
+}
+
+/* Key of an update path, list keys are sorted as Map order is unspecified */
+static string path_key(const gnmi::Path &path)
+{
+  string key = path.origin() + ":";
+
+  for (auto &elem : path.elem()) {
+    map<string, string> keys(elem.key().begin(), elem.key().end());
+
+    key += "/" + elem.name();
+    for (auto &it : keys)
+      key += "[" + it.first + "=" + it.second + "]";
+  }
+
+  return key;
+}
+
+/* Schema node identifier of an update, with the module of its origin */
+static string schema_path(const gnmi::Path *prefix, const gnmi::Path &path)
+{
+  const gnmi::Path *parts[] = {prefix, &path};
+  string schema;
+
+  for (auto part : parts) {
+    if (part == nullptr)
+      continue;
+    for (auto &elem : part->elem()) {
+      schema += "/";
+      if (schema.size() == 1 && !part->origin().empty()
+          && elem.name().find(':') == string::npos)
+        schema += part->origin() + ":";
+      schema += elem.name();
+    }
+  }
+
+  return schema;
+}
+
+/* Value of a numeric JSON leaf, false if leaf is not numeric */
+static bool numeric(const Json::Value &val, long double *num, int *decimals)
+{
+  string str;
+  size_t i = 0, digits;
+
+  switch (val.type()) {
+    case Json::intValue:
+      *num = val.asLargestInt();
+      *decimals = 0;
+      return true;
+    case Json::uintValue:
+      *num = val.asLargestUInt();
+      *decimals = 0;
+      return true;
+    case Json::realValue:
+      *num = val.asDouble();
+      *decimals = -1;
+      return true;
+    case Json::stringValue:
+      break;
+    default:
+      return false;
+  }
+
+  /* [-]DIGITS[.DIGITS], as integers and decimal64 in JSON IETF */
+  str = val.asString();
+  if (i < str.size() && str[i] == '-')
+    i++;
+  for (digits = i; i < str.size() && isdigit(str[i]); i++);
+  if (i == digits)
+    return false;
+
+  *decimals = 0;
+  if (i < str.size() && str[i] == '.') {
+    for (digits = ++i; i < str.size() && isdigit(str[i]); i++);
+    if (i == digits)
+      return false;
+    *decimals = i - digits;
+  }
+  if (i != str.size())
+    return false;
+
+  *num = strtold(str.c_str(), nullptr);
+  return true;
+}
+
+/* Position of the entry at index of the JSON array at schema */
+string Aggregator::entry(const string &schema, const Json::Value &val,
+                         Json::ArrayIndex index) const
+{
+  string position;
+
+  if (!val.isObject() && !val.isArray())
+    return "[.=" + val.asString() + "]"; //leaf-list
+
+  auto it = keys.find(schema);
+  if (it == keys.end()) {
+    it = keys.emplace(schema, vector<string>()).first;
+    if (list_keys != nullptr && val.isObject())
+      it->second = list_keys(schema);
+  }
+
+  for (auto &name : it->second) {
+    if (!val.isMember(name) || !val[name].isConvertibleTo(Json::stringValue))
+      return "/" + to_string(index);
+    position += "[" + name + "=" + val[name].asString() + "]";
+  }
+
+  return position.empty() ? "/" + to_string(index) : position;
+}
+
+void Aggregator::accumulate(const string &key, const string &schema,
+                            const Json::Value &val)
+{
+  long double num;
+  int decimals;
+
+  if (val.isObject()) {
+    for (auto &name : val.getMemberNames())
+      accumulate(key + "/" + name, schema + "/" + name, val[name]);
+    return;
+  }
+  if (val.isArray()) {
+    for (Json::ArrayIndex i = 0; i < val.size(); i++)
+      accumulate(key + entry(schema, val[i], i), schema, val[i]);
+    return;
+  }
+  if (!numeric(val, &num, &decimals))
+    return;
+
+  auto it = leaves.find(key);
+  if (it == leaves.end()) {
+    Leaf &leaf = leaves[key];
+    leaf.min = leaf.max = val;
+    leaf.min_num = leaf.max_num = leaf.sum = num;
+    leaf.count = 1;
+    leaf.decimals = decimals;
+    return;
+  }
+
+  Leaf &leaf = it->second;
+  if (num < leaf.min_num) {
+    leaf.min = val;
+    leaf.min_num = num;
+  }
+  if (num > leaf.max_num) {
+    leaf.max = val;
+    leaf.max_num = num;
+  }
+  leaf.sum += num;
+  leaf.count++;
+  if (leaf.decimals >= 0)
+    leaf.decimals = decimals < 0 ? -1 : max(leaf.decimals, decimals);
+}
+
+void Aggregator::add(const gnmi::Notification &sample)
+{
+  Json::Reader reader;
+
+  has_prefix = sample.has_prefix();
+  if (has_prefix)
+    prefix.CopyFrom(sample.prefix());
+
+  for (auto &update : sample.update()) {
+    const gnmi::TypedValue &val = update.val();
+    string key = path_key(update.path());
+    Sampled &sampled = updates[key];
+
+    sampled.path.CopyFrom(update.path());
+    sampled.schema = schema_path(has_prefix ? &prefix : nullptr,
+                                 update.path());
+    sampled.value = Json::Value();
+    if (!reader.parse(val.has_json_ietf_val() ? val.json_ietf_val()
+                                              : val.json_val(),
+                      sampled.value, false)) {
+      GNXI_LOG(SUBSCRIBE, warning) << "Can not aggregate value of " << key;
+      continue;
+    }
+
+    accumulate(key + "#", sampled.schema, sampled.value);
+  }
+}
+
+Json::Value Aggregator::reduce(const string &key, const string &schema,
+                               const Json::Value &val,
+                               Aggregation::Function function) const
+{
+  Json::Value out;
+  long double avg;
+  char buf[64];
+
+  if (val.isObject()) {
+    out = Json::Value(Json::objectValue);
+    for (auto &name : val.getMemberNames())
+      out[name] = reduce(key + "/" + name, schema + "/" + name, val[name],
+                         function);
+    return out;
+  }
+  if (val.isArray()) {
+    out = Json::Value(Json::arrayValue);
+    for (Json::ArrayIndex i = 0; i < val.size(); i++)
+      out.append(reduce(key + entry(schema, val[i], i), schema, val[i],
+                        function));
+    return out;
+  }
+
+  auto it = leaves.find(key);
+  if (it == leaves.end())
+    return val; //last value of non numeric leaves
+  const Leaf &leaf = it->second;
+
+  switch (function) {
+    case Aggregation::MINIMUM:
+      return leaf.min;
+    case Aggregation::MAXIMUM:
+      return leaf.max;
+    default:
+      break;
+  }
+
+  /* Average has the type and precision of sampled values */
+  avg = leaf.sum / leaf.count;
+  if (leaf.decimals < 0)
+    return Json::Value(static_cast<double>(avg));
+  if (!leaf.min.isString())
+    return Json::Value(static_cast<Json::Int64>(llroundl(avg)));
+
+  snprintf(buf, sizeof(buf), "%.*Lf", leaf.decimals, avg);
+  return Json::Value(buf);
+}
+
+vector<gnmi::SubscribeResponse> Aggregator::flush(uint64_t timestamp)
+{
+  vector<gnmi::SubscribeResponse> responses;
+  Json::FastWriter writer;
+
+  if (updates.empty())
+    return responses;
+
+  for (auto function : functions) {
+    gnmi::SubscribeResponse response;
+    gnmi::Notification *notification = response.mutable_update();
+    gnxi_ext::Experimental description;
+    gnmi_ext::RegisteredExtension *ext;
+
+    notification->set_timestamp(timestamp);
+    if (has_prefix)
+      notification->mutable_prefix()->CopyFrom(prefix);
+
+    for (auto &it : updates) {
+      gnmi::Update *update = notification->add_update();
+      update->mutable_path()->CopyFrom(it.second.path);
+      update->mutable_val()->set_json_ietf_val(
+        writer.write(reduce(it.first + "#", it.second.schema,
+                            it.second.value, function)));
+    }
+
+    /* Tell client which function the notification holds */
+    description.mutable_aggregation()->set_window(window_ns);
+    description.mutable_aggregation()->add_functions(function);
+    ext = response.add_extension()->mutable_registered_ext();
+    ext->set_id(gnmi_ext::EID_EXPERIMENTAL);
+    ext->set_msg(description.SerializeAsString());
+
+    responses.push_back(response);
+  }
+
+  updates.clear();
+  leaves.clear();
+
+  return responses;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNMI_AGGREGATE_H
+#define _GNMI_AGGREGATE_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <jsoncpp/json/json.h>
+
+#include <proto/gnmi.pb.h>
+#include <proto/gnxi_ext.pb.h>
+
+/*
+ * Aggregator - Downsampling of the SAMPLE subscriptions of a stream.
+ * Samples are accumulated over a window, then numeric leaves of their JSON
+ * values are reduced to their minimum, maximum or average. JSON numbers and
+ * JSON strings holding a decimal number, like 64 bits counters, are numeric.
+ * A leaf is identified by the path of its Update and its position in the
+ * JSON value: entries of a YANG list are identified by their key values,
+ * entries of a leaf-list by their value, so that entries inserted or moved
+ * between samples are not mixed up. Entries of a list whose keys are
+ * unknown are identified by their index.
+ */
+class Aggregator {
+  public:
+    /* Key names of the YANG list at a schema node identifier, like
+     * /module:container/list, empty if it is not a list */
+    typedef std::function<std::vector<std::string>(const std::string&)>
+            KeyResolver;
+
+    /* @throw invalid_argument if window is 0 or a function is unknown */
+    Aggregator(const gnxi_ext::Aggregation &aggregation,
+               KeyResolver resolver = nullptr);
+    ~Aggregator() {}
+
+    uint64_t window() const { return window_ns; } //in nanoseconds
+
+    /* Accumulate updates of a sample */
+    void add(const gnmi::Notification &sample);
+
+    /*
+     * Build one Notification per function with the samples of the window,
+     * and start a new window.
+     * @param timestamp timestamp of the notifications
+     * @return responses with an extension naming their function, none if no
+     *         sample was added
+     */
+    std::vector<gnmi::SubscribeResponse> flush(uint64_t timestamp);
+
+  private:
+    /* Statistics of a numeric leaf */
+    struct Leaf {
+      Json::Value min, max; //sampled values, sent as is
+      long double min_num, max_num, sum;
+      uint64_t count;
+      int decimals; //fraction digits, -1 for JSON floating point numbers
+    };
+
+    /* Last sampled value of an update */
+    struct Sampled {
+      gnmi::Path path;
+      std::string schema; //schema node identifier of path
+      Json::Value value;
+    };
+
+    std::string entry(const std::string &schema, const Json::Value &val,
+                      Json::ArrayIndex index) const;
+    void accumulate(const std::string &key, const std::string &schema,
+                    const Json::Value &val);
+    Json::Value reduce(const std::string &key, const std::string &schema,
+                       const Json::Value &val,
+                       gnxi_ext::Aggregation::Function function) const;
+
+  private:
+    uint64_t window_ns;
+    std::vector<gnxi_ext::Aggregation::Function> functions;
+    gnmi::Path prefix; //prefix of last sample
+    bool has_prefix;
+    std::map<std::string, Sampled> updates; //by update path
+    std::map<std::string, Leaf> leaves; //by update path and JSON position
+    KeyResolver list_keys; //nullptr if keys of lists are unknown
+    mutable std::map<std::string, std::vector<std::string>> keys; //by schema
+};
+
+#endif //_GNMI_AGGREGATE_H
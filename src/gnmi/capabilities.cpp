@@ -16,33 +16,21 @@
 
 #include "gnmi.h"
 #include <utils/log.h>
+#include <utils/metrics.h>
 
 using namespace gnmi;
 using namespace std;
-using sysrepo::Yang_Schemas;
-using google::protobuf::FileOptions;
 
-Status GNMIService::Capabilities(ServerContext *context,
-                                 const CapabilityRequest* request,
-                                 CapabilityResponse* response)
+/* Build CapabilityResponse from the list of schemas of the datastore */
+Status GNMIService::BuildCapabilityResponse(CapabilityResponse* response)
 {
-  (void)context;
-  shared_ptr<Yang_Schemas> schemas;
   string gnmi_version;
-  FileOptions fopts;
-
-  if (request->extension_size() > 0) {
-    BOOST_LOG_TRIVIAL(error) << "Extensions not implemented";
-    return Status(StatusCode::UNIMPLEMENTED, "Extensions not implemented");
-  }
 
   try {
-    schemas = sr_sess->list_schemas();
-
-    for (unsigned int i = 0; i < schemas->schema_cnt(); i++) {
+    for (auto &mod : datastore->modules()) {
       auto model = response->add_supported_models();
-      model->set_name(schemas->schema(i)->module_name());
-      model->set_version(schemas->schema(i)->revision()->revision());
+      model->set_name(mod.name);
+      model->set_version(mod.revision);
     }
 
     gnmi_version = response->GetDescriptor()->file()->options()
@@ -57,9 +45,61 @@ Status GNMIService::Capabilities(ServerContext *context,
     response->add_supported_encodings(gnmi::Encoding::JSON_IETF);
 
   } catch (const exception &exc) {
-    BOOST_LOG_TRIVIAL(error) << exc.what();
+    GNXI_LOG(SERVER, error) << exc.what();
     return Status(StatusCode::INTERNAL, "Fail getting schemas");
   }
 
   return Status::OK;
 }
+
+/*
+ * Capabilities are answered from a cached CapabilityResponse.
+ * The cache is rebuilt only when the datastore notified a module installation
+ * or a feature change since it was built.
+ */
+Status GNMIService::Capabilities(ServerContext *context,
+                                 const CapabilityRequest* request,
+                                 CapabilityResponse* response)
+{
+  CapabilityResponse fresh;
+  uint64_t version;
+  size_t size;
+  Status status;
+  Metrics &metrics = Metrics::get();
+  LatencyTimer timer(metrics.duration(Metrics::CAPABILITIES));
+
+  metrics.request(Metrics::CAPABILITIES);
+
+  if (request->extension_size() > 0) {
+    GNXI_LOG(SERVER, error) << "Extensions not implemented";
+    metrics.response(Metrics::CAPABILITIES, StatusCode::UNIMPLEMENTED);
+    return Status(StatusCode::UNIMPLEMENTED, "Extensions not implemented");
+  }
+
+  lock_guard<mutex> lock(cap_mutex);
+
+  version = encodef->schemaVersion();
+  if (!cap_valid || cap_version != version) {
+    GNXI_LOG(SERVER, debug) << "Rebuild CapabilityResponse";
+    status = BuildCapabilityResponse(&fresh);
+    if (!status.ok()) {
+      metrics.response(Metrics::CAPABILITIES, status.error_code());
+      return status;
+    }
+
+    cap_cache.Swap(&fresh);
+    cap_version = version;
+    cap_valid = true;
+    metrics.cacheMiss(Metrics::CAPABILITY_CACHE);
+  } else {
+    metrics.cacheHit(Metrics::CAPABILITY_CACHE);
+  }
+
+  response->CopyFrom(cap_cache);
+  size = response->ByteSizeLong();
+  metrics.sent(Metrics::CAPABILITIES, size);
+  compression.apply(context, Compression::CAPABILITIES, size);
+  metrics.response(Metrics::CAPABILITIES, StatusCode::OK);
+
+  return Status::OK;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compression.h"
+
+using namespace std;
+
+Compression::Compression()
+  : threshold(0)
+{
+  setDefault(GRPC_COMPRESS_NONE);
+}
+
+bool Compression::parseAlgorithm(const string &name,
+                                 grpc_compression_algorithm *algo)
+{
+  if (name == "none" || name == "identity")
+    *algo = GRPC_COMPRESS_NONE;
+  else if (name == "deflate")
+    *algo = GRPC_COMPRESS_DEFLATE;
+  else if (name == "gzip")
+    *algo = GRPC_COMPRESS_GZIP;
+  else
+    return false;
+
+  return true;
+}
+
+bool Compression::parseRpc(const string &name, Rpc *rpc)
+{
+  if (name == "capabilities")
+    *rpc = CAPABILITIES;
+  else if (name == "get")
+    *rpc = GET;
+  else if (name == "set")
+    *rpc = SET;
+  else if (name == "subscribe")
+    *rpc = SUBSCRIBE;
+  else
+    return false;
+
+  return true;
+}
+
+void Compression::setDefault(grpc_compression_algorithm algo)
+{
+  for (int i = 0; i < RPC_MAX; i++)
+    algos[i] = algo;
+}
+
+void Compression::setRpc(Rpc rpc, grpc_compression_algorithm algo)
+{
+  algos[rpc] = algo;
+}
+
+bool Compression::apply(grpc::ServerContextBase *context, Rpc rpc,
+                        size_t size) const
+{
+  grpc_compression_algorithm algo = algos[rpc];
+
+  if (algo == GRPC_COMPRESS_NONE)
+    return false;
+
+  /* unary response too small to be worth compressing */
+  if (size > 0 && size < threshold)
+    return false;
+
+  /* grpc-accept-encoding is consumed by gRPC core, which sends identity
+   * encoded messages to clients not accepting algo */
+  context->set_compression_algorithm(algo);
+
+  return true;
+}
+
+grpc::WriteOptions Compression::writeOptions(size_t size) const
+{
+  grpc::WriteOptions opts;
+
+  if (size < threshold)
+    opts.set_no_compression();
+
+  return opts;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNMI_COMPRESSION_H
+#define _GNMI_COMPRESSION_H
+
+#include <string>
+
+#include <grpc/compression.h>
+#include <grpcpp/server_context.h>
+
+/*
+ * Compression - Message compression policy of gNMI RPCs.
+ * An algorithm is configured globally and can be overridden per RPC. It is
+ * used only for messages bigger than a size threshold: small messages are
+ * not worth the CPU spent compressing them. gRPC core falls back to identity
+ * encoding for clients which did not advertise the algorithm in
+ * grpc-accept-encoding.
+ */
+class Compression {
+  public:
+    enum Rpc { CAPABILITIES, GET, SET, SUBSCRIBE, RPC_MAX };
+
+    Compression();
+    ~Compression() {}
+
+    /* Parse algorithm name {none, identity, deflate, gzip} */
+    static bool parseAlgorithm(const std::string &name,
+                               grpc_compression_algorithm *algo);
+    /* Parse RPC name {capabilities, get, set, subscribe} */
+    static bool parseRpc(const std::string &name, Rpc *rpc);
+
+    void setDefault(grpc_compression_algorithm algo);
+    void setRpc(Rpc rpc, grpc_compression_algorithm algo);
+    void setThreshold(size_t bytes) { threshold = bytes; }
+
+    /*
+     * Compress messages of a call with the algorithm configured for rpc.
+     * Must be called before the first message is sent.
+     * @param size size of the response for unary RPC, 0 if unknown
+     * @return true if the call is compressed
+     */
+    bool apply(grpc::ServerContextBase *context, Rpc rpc,
+               size_t size = 0) const;
+
+    /* Options to write a streamed message of a compressed call */
+    grpc::WriteOptions writeOptions(size_t size) const;
+
+  private:
+    grpc_compression_algorithm algos[RPC_MAX];
+    size_t threshold; //minimum message size to compress in bytes
+};
+
+#endif //_GNMI_COMPRESSION_H
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <exception>
+#include <libyang/Tree_Schema.hpp>
+
+#include <utils/log.h>
+
+#include "context.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace libyang;
+
+SchemaContext::SchemaContext(shared_ptr<Datastore> store)
+  : ctx(make_shared<Context>()), generation(0), datastore(store)
+{
+}
+
+void SchemaContext::add(const string &name, const string &revision,
+                        const string &text, const vector<string> &features)
+{
+  lock_guard<mutex> lock(writer);
+  Module &mod = modules[name];
+
+  mod.revision = revision;
+  mod.text = text;
+  mod.features.insert(features.begin(), features.end());
+}
+
+/*
+ * Build a new libyang context from registered modules.
+ * Must be called with writer lock held.
+ */
+shared_ptr<Context> SchemaContext::build()
+{
+  shared_ptr<Context> fresh = make_shared<Context>();
+  Context *raw = fresh.get();
+  S_Module mod;
+
+  /* Callback for missing modules, served from registered modules */
+  auto mod_c_cb = [this, raw](const char *mod_name, const char *mod_rev,
+    const char *, const char *) -> libyang::Context::mod_missing_cb_return {
+        string str; S_Module mod;
+
+        GNXI_LOG(ENCODE, debug) << "Importing missing dependency " << mod_name;
+        auto cached = this->modules.find(mod_name);
+        if (cached != this->modules.end())
+          str = cached->second.text;
+        else
+          str = this->datastore->schema(mod_name, mod_rev ? mod_rev : "");
+
+        try {
+          mod = raw->parse_module_mem(str.c_str(), LYS_IN_YANG);
+        } catch (const exception &exc) {
+          GNXI_LOG(ENCODE, warning) << exc.what();
+        }
+
+        return {LYS_IN_YANG, mod_name};
+    };
+
+  fresh->add_missing_module_callback(mod_c_cb);
+
+  /* Dependencies are resolved by the missing module callback */
+  for (auto &it : modules) {
+    auto start = steady_clock::now();
+
+    mod = fresh->get_module(it.first.c_str(), it.second.revision.c_str());
+    if (mod != nullptr) {
+      GNXI_LOG(ENCODE, debug) << "Module was already loaded: "
+                              << it.first << "@" << it.second.revision;
+    } else {
+      try {
+        mod = fresh->parse_module_mem(it.second.text.c_str(), LYS_IN_YANG);
+      } catch (const exception &exc) {
+        GNXI_LOG(ENCODE, warning) << exc.what();
+        continue;
+      }
+      GNXI_LOG(ENCODE, debug) << "Parsed " << it.first << "@"
+                              << it.second.revision << " in "
+                              << duration_cast<microseconds>(
+                                   steady_clock::now() - start).count()
+                              << " us";
+    }
+
+    for (auto &feature_name : it.second.features) {
+      GNXI_LOG(ENCODE, debug) << "Loading feature " << feature_name
+                              << " in module " << mod->name();
+      mod->feature_enable(feature_name.c_str());
+    }
+  }
+
+  return fresh;
+}
+
+void SchemaContext::publish()
+{
+  lock_guard<mutex> lock(writer);
+  auto start = steady_clock::now();
+  shared_ptr<Context> fresh = build();
+
+  atomic_store(&ctx, fresh);
+  generation++;
+
+  GNXI_LOG(ENCODE, info) << "Published libyang context with "
+                         << modules.size() << " modules in "
+                         << duration_cast<milliseconds>(
+                              steady_clock::now() - start).count()
+                         << " ms";
+}
+
+void SchemaContext::install(const string &name, const string &revision,
+                            const string &text)
+{
+  {
+    lock_guard<mutex> lock(writer);
+    auto it = modules.find(name);
+
+    if (it != modules.end() && it->second.revision == revision) {
+      GNXI_LOG(ENCODE, debug) << "Module was already loaded: "
+                              << name << "@" << revision;
+      return;
+    }
+
+    modules[name].revision = revision;
+    modules[name].text = text;
+  }
+
+  publish();
+}
+
+void SchemaContext::feature(const string &module, const string &feature,
+                            bool enable)
+{
+  {
+    lock_guard<mutex> lock(writer);
+    auto it = modules.find(module);
+
+    if (it == modules.end()) {
+      GNXI_LOG(ENCODE, warning) << "Unknown module " << module;
+      return;
+    }
+
+    if (enable)
+      it->second.features.insert(feature);
+    else
+      it->second.features.erase(feature);
+  }
+
+  publish();
+}
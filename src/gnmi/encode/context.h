@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CONTEXT_H
+#define _CONTEXT_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <libyang/Libyang.hpp>
+
+#include <datastore/datastore.h>
+
+/*
+ * SchemaContext - libyang context shared by gRPC threads and datastore
+ * listeners, published in a Read-Copy-Update fashion.
+ *
+ * Readers pin the current context with get() and keep using their snapshot
+ * for as long as they hold it. Writers never modify a published context:
+ * installing a module or changing a feature builds a new context off to the
+ * side from the YANG modules already downloaded, then atomically swaps it in.
+ * Readers are never blocked by a rebuild, only writers are serialized.
+ */
+class SchemaContext {
+  public:
+    SchemaContext(std::shared_ptr<Datastore> store);
+    ~SchemaContext() {}
+
+    /* Snapshot of the current libyang context */
+    std::shared_ptr<libyang::Context> get() const {
+      return std::atomic_load(&ctx);
+    }
+
+    /* Incremented every time a new context is published */
+    uint64_t version() const { return generation.load(); }
+
+    /* Register a YANG module, taken into account by the next publish() */
+    void add(const std::string &name, const std::string &revision,
+             const std::string &text, const std::vector<std::string> &features);
+
+    /* Build a context with every registered module and publish it */
+    void publish();
+
+    /* Add a module then publish a new context */
+    void install(const std::string &name, const std::string &revision,
+                 const std::string &text);
+
+    /* Enable/disable a feature then publish a new context */
+    void feature(const std::string &module, const std::string &feature,
+                 bool enable);
+
+  private:
+    struct Module {
+      std::string revision;
+      std::string text; //YANG format
+      std::set<std::string> features; //enabled features
+    };
+
+    std::shared_ptr<libyang::Context> build();
+
+  private:
+    std::shared_ptr<libyang::Context> ctx; //published context
+    std::atomic<uint64_t> generation;
+    std::mutex writer; //serialize writers, protects modules
+    std::map<std::string, Module> modules;
+    std::shared_ptr<Datastore> datastore; //source of missing modules
+};
+
+#endif //_CONTEXT_H
@@ -18,42 +18,76 @@
 #define _ENCODE_H
 
 #include <libyang/Libyang.hpp>
-#include <sysrepo-cpp/Session.hpp>
+
+#include <functional>
 
 #include <jsoncpp/json/json.h>
 
+#include <proto/gnmi.pb.h>
+
+#include <datastore/datastore.h>
+
+#include "context.h"
+
 using std::shared_ptr;
 using std::string;
 using std::vector;
 
 /*
  * Encode directory aims at providing a CREATE-UPDATE-READ wrapper on top of
- * sysrepo for JSON encoding (other encodings can be added).
+ * the datastore for JSON encoding (other encodings can be added).
  * It provides YANG validation before storing elements and after fetching them
- * in sysrepo.
+ * in the datastore.
  *
  * -update()  CREATE & UPDATE
  * -read()    READ
  *
  * DELETE is not supported as it is not dependent of encodings.
- * Use sr_delete_item to suppress subtree from a xpath directly.
+ * Use Datastore::remove to suppress subtree from a xpath directly.
  */
 
 struct JsonData {
   JsonData() {}
   /* Field containing a YANG list key [name=value] */
   std::pair<string, string> key;
+  /* Field containing the absolute xpath of the YANG element, can be empty */
+  string xpath;
   /* Field containing the JSON tree under the designed YANG element */
   string data;
 };
 
+/* Part of the subtrees returned by a read */
+struct ReadOptions {
+  ReadOptions() : depth(0), offset(0), limit(0) {}
+  uint32_t depth; //levels of data nodes below xpath, 0 for all
+  uint64_t offset; //list entries skipped
+  uint64_t limit; //list entries read, 0 for all
+
+  /* Reads return whole subtrees, they hold the data of their descendants */
+  bool whole() const { return depth == 0 && offset == 0 && limit == 0; }
+};
+
+/*
+ * Data of path in the JSON IETF tree of an update, paths covered by another
+ * path of a request are served from the updates read for the other path.
+ * Paths are relative to the same prefix, path selects at most one node.
+ * @param tree_path path of the update
+ * @param tree JSON data of the update
+ * @param out_path path of the data found, with the keys of tree_path
+ * @param out JSON data found, left empty if the update does not hold path
+ * @return false if path can not be resolved without the schema: wildcards,
+ *         or list entries without keys below tree_path, it must be read
+ */
+bool json_extract(const gnmi::Path &tree_path, const string &tree,
+                  const gnmi::Path &path, gnmi::Path *out_path, string *out);
+
 /*
  * Factory to instantiate encodings
  * Encoding can be {JSON, Bytes, Proto, ASCII, JSON_IETF}
  */
 class Encode {
   public:
-    Encode(std::shared_ptr<sysrepo::Session> sr_sess);
+    Encode(std::shared_ptr<Datastore> store);
     ~Encode();
 
     /* Supported Encodings */
@@ -61,18 +95,35 @@ class Encode {
       JSON_IETF = 0,
     };
 
-    /* JSON encoding */
-    void json_update(string data);
-    vector<JsonData> json_read(string xpath);
+    /* Incremented every time the datastore installs a module or changes a
+     * feature */
+    uint64_t schemaVersion() const { return schema_ctx->version(); }
+
+    /* JSON encoding
+     * json_update calls check, if set, with the xpath of every node to be
+     * stored before storing any of them, check throws to reject the data. */
+    void json_update(string data,
+                     const std::function<void(const string&)> &check = nullptr);
+    vector<JsonData> json_read(const string &xpath);
+    /* Same as json_read, every tree is passed to sink as soon as it is
+     * encoded and released after it, sink returns false to stop reading.
+     * Pagination is part of the datastore query, depth prunes trees before
+     * they are encoded. */
+    void json_read(const string &xpath,
+                   const std::function<bool(JsonData&)> &sink,
+                   const ReadOptions &options = ReadOptions());
+
+    /* Key names of the YANG list at schema_path, a schema node identifier
+     * like /module:container/list, empty if it is not a list */
+    vector<string> listKeys(const string &schema_path);
 
   private:
     void storeTree(libyang::S_Data_Node node);
     void storeLeaf(libyang::S_Data_Node_Leaf_List node);
 
   private:
-    std::shared_ptr<libyang::Context> ctx;
-    std::shared_ptr<sysrepo::Session> sr_sess;
-    sysrepo::S_Subscribe sub; //must be out of constructor to recv callback
+    std::shared_ptr<SchemaContext> schema_ctx; //published libyang context
+    std::shared_ptr<Datastore> datastore;
 };
 
 #endif //_ENCODE_H
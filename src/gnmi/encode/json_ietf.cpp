@@ -14,12 +14,14 @@
  * limitations under the License.
  */
 
-#include <sysrepo-cpp/Struct.hpp>
-#include <sysrepo-cpp/Sysrepo.hpp>
+#include <chrono>
+#include <cstdint>
+
 #include <libyang/Tree_Schema.hpp>
 #include <libyang/Tree_Data.hpp>
 
 #include <utils/log.h>
+#include <utils/metrics.h>
 
 #include "encode.h"
 
@@ -32,18 +34,35 @@ using namespace libyang;
  *****************/
 
 /*
- * Parse a message encoded in JSON IETF and set fields in sysrepo.
+ * Parse a message encoded in JSON IETF and set fields in the datastore.
  * @param data Input data encoded in JSON
+ * @param check callback validating xpath of nodes, can be empty
  */
-void Encode::json_update(string data)
+void Encode::json_update(string data,
+                         const std::function<void(const string&)> &check)
 {
   S_Data_Node node;
+  S_Context ctx = schema_ctx->get(); //pin context for the whole update
 
   /* Parse input JSON, same options than netopeer2 edit-config */
   node = ctx->parse_data_mem(data.c_str(), LYD_JSON, LYD_OPT_EDIT |
                                                      LYD_OPT_STRICT);
 
-  /* store Data Tree to sysrepo */
+  /* Validate every node before the first change in the datastore */
+  if (check) {
+    for (auto it : node->tree_dfs()) {
+      switch (it->schema()->nodetype()) {
+        case LYS_LEAF:
+        case LYS_LIST:
+          check(it->path());
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  /* store Data Tree to the datastore */
   storeTree(node);
 }
 
@@ -51,136 +70,198 @@ void Encode::json_update(string data)
  * CRUD - READ *
  ***************/
 
-static Json::Value json_tree(sysrepo::S_Tree tree)
+/*
+ * Keep leaves of val up to depth levels below it. Containers and list
+ * entries are one level, leaf-lists are leaves.
+ */
+static void prune(Json::Value &val, uint32_t depth)
 {
-  sysrepo::S_Tree iter;
-  Json::Value val;
-
-  // run through all siblings
-  for (iter = tree->first_child(); iter != nullptr; iter = iter->next()) {
-    //create sibling with "node" as a parent
-    switch (iter->type()) { //follows RFC 7951
-      /* JSON Number */
-      case SR_UINT8_T:
-        val[iter->name()] = iter->data()->get_uint8();
-        break;
-      case SR_UINT16_T:
-        val[iter->name()] = iter->data()->get_uint16();
-        break;
-      case SR_UINT32_T:
-        val[iter->name()] = iter->data()->get_uint32();
-        break;
-      case SR_INT8_T:
-        val[iter->name()] = iter->data()->get_int8();
-        break;
-      case SR_INT16_T:
-        val[iter->name()] = iter->data()->get_int16();
-        break;
-      case SR_INT32_T:
-        val[iter->name()] = iter->data()->get_int32();
-        break;
+  if (!val.isObject())
+    return;
 
-      /* JSON string */
-      case SR_STRING_T:
-        val[iter->name()] = iter->data()->get_string();
-        break;
-      case SR_INT64_T:
-        val[iter->name()] = to_string(iter->data()->get_int64());
-        break;
-      case SR_UINT64_T:
-        val[iter->name()] = to_string(iter->data()->get_uint64());
-        break;
-      case SR_DECIMAL64_T:
-        val[iter->name()] = to_string(iter->data()->get_decimal64());
-        break;
-      case SR_IDENTITYREF_T:
-        val[iter->name()] = iter->data()->get_identityref();
-        break;
-      case SR_INSTANCEID_T:
-        val[iter->name()] = iter->data()->get_identityref();
-        break;
-      case SR_BINARY_T:
-        val[iter->name()] = iter->data()->get_binary();
-        break;
-      case SR_BITS_T:
-        val[iter->name()] = iter->data()->get_bits();
-        break;
-      case SR_ENUM_T:
-        val[iter->name()] = iter->data()->get_enum();
-        break;
-      case SR_BOOL_T:
-        val[iter->name()] = iter->data()->get_bool() ? "true" : "false";
-        break;
+  for (auto &name : val.getMemberNames()) {
+    Json::Value &child = val[name];
+    bool list = child.isArray() && child.size() > 0 && child[0].isObject();
 
-      /* JSON arrays */
-      case SR_LIST_T:
-        val[iter->name()].append(json_tree(iter));
-        break;
-      case SR_LEAF_EMPTY_T:
-        val[iter->name()].append("null");
-        break;
+    if (!child.isObject() && !list)
+      continue; //leaf or leaf-list
 
-      /* nested JSON */
-      case SR_CONTAINER_T:
-      case SR_CONTAINER_PRESENCE_T:
-        val[iter->name()] = json_tree(iter);
-        break;
+    if (depth <= 1) {
+      val.removeMember(name);
+    } else if (list) {
+      for (auto &entry : child)
+        prune(entry, depth - 1);
+    } else {
+      prune(child, depth - 1);
+    }
+  }
+}
 
-      /* Unsupported types */
-      case SR_ANYDATA_T:
-      case SR_ANYXML_T:
-        throw invalid_argument("unsupported ANYDATA and ANYXML types");
-        break;
+/* Name of a path element without its module, as in JSON IETF trees */
+static string node_name(const string &name)
+{
+  size_t colon = name.find(':');
+
+  return colon == string::npos ? name : name.substr(colon + 1);
+}
+
+/* True if elem of a returned path is selected by elem of a request */
+static bool elem_matches(const gnmi::PathElem &elem,
+                         const gnmi::PathElem &pattern)
+{
+  if (pattern.name() != "*"
+      && node_name(pattern.name()) != node_name(elem.name()))
+    return false;
 
-      default:
-        BOOST_LOG_TRIVIAL(error) << "Unknown tree node type";
-        throw invalid_argument("Unknown tree node type");
+  for (auto &key : pattern.key()) {
+    auto it = elem.key().find(key.first);
+    if (key.second != "*" && (it == elem.key().end()
+                              || it->second != key.second))
+      return false;
+  }
+
+  return true;
+}
+
+bool json_extract(const gnmi::Path &tree_path, const string &tree,
+                  const gnmi::Path &path, gnmi::Path *out_path, string *out)
+{
+  int depth = tree_path.elem_size();
+  Json::Reader reader;
+  Json::Value root;
+  const Json::Value *node = &root;
+
+  out->clear();
+  if (tree_path.origin() != path.origin())
+    return true;
+
+  for (int i = 0; i < depth && i < path.elem_size(); i++) {
+    if (path.elem(i).name() == "...")
+      return false;
+    if (!elem_matches(tree_path.elem(i), path.elem(i)))
+      return true;
+  }
+
+  /* The update is a descendant of path */
+  out_path->CopyFrom(tree_path);
+  if (depth >= path.elem_size()) {
+    *out = tree;
+    return true;
+  }
+
+  if (!reader.parse(tree, root, false))
+    return false;
+
+  for (int i = depth; i < path.elem_size(); i++) {
+    const gnmi::PathElem &elem = path.elem(i);
+    const string name = node_name(elem.name());
+    const Json::Value *child;
+
+    if (elem.name() == "*" || elem.name() == "...")
+      return false;
+    if (!node->isObject() || !node->isMember(name))
+      return true;
+    child = &(*node)[name];
+    out_path->add_elem()->CopyFrom(elem);
+
+    if (elem.key().empty()) {
+      /* Entries of a list are named by keys we do not know */
+      if (child->isArray() && child->size() > 0 && (*child)[0].isObject())
+        return false;
+      node = child;
+      continue;
+    }
+
+    /* List entry selected by its keys */
+    if (!child->isArray())
+      return false;
+    node = nullptr;
+    for (auto &entry : *child) {
+      bool match = entry.isObject();
+      for (auto &key : elem.key()) {
+        if (key.second == "*")
+          return false;
+        match = match && entry.isMember(key.first)
+                && entry[key.first].isConvertibleTo(Json::stringValue)
+                && entry[key.first].asString() == key.second;
+      }
+      if (match) {
+        node = &entry;
+        break;
       }
+    }
+    if (node == nullptr)
+      return true;
   }
-  return val;
+
+  *out = Json::FastWriter().write(*node);
+  return true;
 }
 
-/* Get sysrepo subtree data corresponding to XPATH */
-vector<JsonData> Encode::json_read(string xpath)
+/* Get datastore subtree data corresponding to XPATH */
+vector<JsonData> Encode::json_read(const string &xpath)
 {
-  sysrepo::S_Trees sr_trees;
-  sysrepo::S_Tree sr_tree;
   vector<JsonData> json_vec;
+
+  json_read(xpath, [&json_vec](JsonData &data) {
+    json_vec.push_back(std::move(data));
+    return true;
+  });
+
+  return json_vec;
+}
+
+void Encode::json_read(const string &xpath,
+                       const std::function<bool(JsonData&)> &sink,
+                       const ReadOptions &options)
+{
   Json::StyledWriter styledwriter; //pretty JSON
   Json::FastWriter fastWriter; //unreadable JSON
-  Json::Value val;
-  JsonData tmp;
-  string key_name, key_value;
-
-  BOOST_LOG_TRIVIAL(debug) << "read and encode in json data for " << xpath;
-
-  /* Get multiple subtree for YANG lists or one for other YANG types */
-  sr_trees = sr_sess->get_subtrees(xpath.c_str());
-    if (sr_trees == nullptr)
-      throw invalid_argument("xpath not found");
-
-  for (size_t i = 0; i < sr_trees->tree_cnt(); i++) {
-    sr_tree = sr_trees->tree(i);
-    val = json_tree(sr_tree);
-
-    /*
-     * Pass a pair containing key name and key value.
-     * keys are always first element of children in sysrepo trees
-     */
-    if (sr_tree->type() == SR_LIST_T) {
-      tmp.key.first = string(sr_tree->first_child()->name());
-      tmp.key.second = val[tmp.key.first].asString();
-      BOOST_LOG_TRIVIAL(debug) << tmp.key.first << ":" << tmp.key.second;
-    }
+  chrono::steady_clock::duration encoding(0); //time spent encoding
+  chrono::steady_clock::duration reading(0); //time spent in datastore
+  chrono::steady_clock::time_point start;
 
-    /* Print Pretty JSON message */
-    BOOST_LOG_TRIVIAL(debug) << styledwriter.write(val);
+  GNXI_LOG(ENCODE, debug) << "read and encode in json data for " << xpath;
 
-    /* Fast unreadable JSON message */
-    tmp.data = fastWriter.write(val);
+  /*
+   * Trees are pulled from one snapshot of the datastore and encoded one at
+   * a time, a large list is never held whole in memory. The page requested
+   * by the client is part of the datastore query.
+   */
+  start = chrono::steady_clock::now();
+  datastore->iterate(
+    Datastore::page(xpath, options.offset, options.limit),
+    [&](DataTree &tree) {
+      auto encode = chrono::steady_clock::now();
+      JsonData tmp;
 
-    json_vec.push_back(tmp);
-  }
+      /* Datastore read, including conversion to the JSON data model */
+      reading += encode - start;
 
-  return json_vec;
+      /* Pass a pair containing key name and key value. */
+      tmp.key = tree.key;
+      if (!tmp.key.first.empty())
+        GNXI_LOG(ENCODE, debug) << tmp.key.first << ":" << tmp.key.second;
+
+      tmp.xpath = tree.xpath;
+
+      if (options.depth > 0)
+        prune(tree.value, options.depth);
+
+      /* Print Pretty JSON message */
+      GNXI_LOG(ENCODE, debug) << styledwriter.write(tree.value);
+
+      /* Fast unreadable JSON message */
+      tmp.data = fastWriter.write(tree.value);
+      tree.value = Json::Value(); //only its encoding is kept
+      encoding += chrono::steady_clock::now() - encode;
+
+      bool more = sink(tmp);
+      start = chrono::steady_clock::now();
+      return more;
+    });
+  reading += chrono::steady_clock::now() - start;
+
+  Metrics::get().phase(Metrics::SYSREPO_READ).observe(reading);
+  Metrics::get().phase(Metrics::ENCODE).observe(encoding);
 }
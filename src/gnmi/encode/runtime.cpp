@@ -31,78 +31,65 @@ static void print_loaded_module(std::shared_ptr<libyang::Context> ctx)
        << endl;
 }
 
-/* install - download module and load it in our libyang context. */
-void RuntimeSrCallback::install(const char *module_name, const char *revision)
+/*
+ * install - download module and load it in a new libyang context.
+ * The new context is published once built, gRPC threads keep using the
+ * previous one until then.
+ */
+void RuntimeListener::install(const string &module, const string &revision)
 {
-  libyang::S_Module mod;
+  shared_ptr<SchemaContext> schema_ctx = ctx.lock();
+  shared_ptr<Datastore> store = datastore.lock();
   string str;
 
+  if (schema_ctx == nullptr || store == nullptr)
+    return;
+
   /* Is module already loaded with libyang? */
-  mod = ctx->get_module(module_name, revision);
-  if (mod != nullptr) {
-    BOOST_LOG_TRIVIAL(debug) << "Module was already loaded: "
-                             << module_name << "@" << revision;
+  if (schema_ctx->get()->get_module(module.c_str(),
+                                    revision.empty() ? nullptr
+                                                     : revision.c_str())
+      != nullptr) {
+    GNXI_LOG(ENCODE, debug) << "Module was already loaded: "
+                            << module << "@" << revision;
     return;
   }
 
-  /* Download module from sysrepo */
+  /* Download module from the datastore */
   try {
-    BOOST_LOG_TRIVIAL(debug) << "Download " << module_name << " from sysrepo";
-    str = sr_sess->get_schema(module_name, revision, nullptr, SR_SCHEMA_YANG);
+    GNXI_LOG(ENCODE, debug) << "Download " << module << " from datastore";
+    str = store->schema(module, revision);
   } catch (const exception &exc) {
-    BOOST_LOG_TRIVIAL(warning) << exc.what();
+    GNXI_LOG(ENCODE, warning) << exc.what();
     return;
   }
 
-  /* parse module */
+  /* parse module in a new context and publish it */
   try {
-    BOOST_LOG_TRIVIAL(debug) << "Parse " << module_name << " with libyang";
-    mod = ctx->parse_module_mem(str.c_str(), LYS_IN_YANG);
+    GNXI_LOG(ENCODE, debug) << "Parse " << module << " with libyang";
+    schema_ctx->install(module, revision, str);
   } catch (const exception &exc) {
-    BOOST_LOG_TRIVIAL(warning) << exc.what();
+    GNXI_LOG(ENCODE, warning) << exc.what();
     return;
   }
+
+  print_loaded_module(schema_ctx->get());
 }
 
-/* module_install - Actions performed after sysrepo install/uninstall module
- * event. */
-void
-RuntimeSrCallback::module_install(const char *module_name, const char *revision,
-                               sr_module_state_t state, void *private_ctx)
+void RuntimeListener::feature(const string &module, const string &feature,
+                              bool enable)
 {
-  (void)private_ctx;
+  shared_ptr<SchemaContext> schema_ctx = ctx.lock();
 
-  if (ctx == nullptr) {
-    BOOST_LOG_TRIVIAL(error) << "Context can not be null";
+  if (schema_ctx == nullptr)
     return;
-  }
-
-  switch (state) {
-  case SR_MS_UNINSTALLED:
-    BOOST_LOG_TRIVIAL(warning) << "Impossible to remove a module at runtime";
-    break;
 
-  case SR_MS_IMPORTED:
-  case SR_MS_IMPLEMENTED:
-    BOOST_LOG_TRIVIAL(info) << "Install " << module_name;
-    install(module_name, revision);
-    print_loaded_module(ctx);
-    break;
+  GNXI_LOG(ENCODE, info) << (enable ? "Enable" : "Disable") << " feature "
+                         << feature << " of " << module;
 
-  default:
-    BOOST_LOG_TRIVIAL(error) << "Unknown state";
+  try {
+    schema_ctx->feature(module, feature, enable);
+  } catch (const exception &exc) {
+    GNXI_LOG(ENCODE, warning) << exc.what();
   }
 }
-
-void
-RuntimeSrCallback::feature_enable(const char *module_name,
-                                   const char *feature_name, bool enable,
-                                   void *private_ctx)
-{
-  (void)private_ctx; (void) enable;
-  BOOST_LOG_TRIVIAL(warning) << "Impossible to enable/disable feature "
-                             << string(feature_name) << " of "
-                             << string(module_name)
-                             << " at runtime";
-}
-
@@ -17,33 +17,34 @@
 #ifndef _RUNTIME_H
 #define _RUNTIME_H
 
-#include <sysrepo-cpp/Session.hpp>
 #include <libyang/Tree_Schema.hpp>
 
+#include <datastore/datastore.h>
+
+#include "context.h"
+
 /*
- * RuntimeSrCallback - Class defining callbacks to perform installation of
+ * RuntimeListener - Class defining callbacks to perform installation of
  * module, enablement of feature in sysrepo-gnxi libyang context.
- * It is triggered by sysrepo events like module installation, feature
+ * It is triggered by datastore events like module installation, feature
  * enablement
  */
-class RuntimeSrCallback : public sysrepo::Callback {
+class RuntimeListener : public Datastore::Listener {
   public:
-    RuntimeSrCallback(std::shared_ptr<libyang::Context> context,
-                      std::shared_ptr<sysrepo::Session> sess)
-      : ctx(context), sr_sess(sess) {}
+    RuntimeListener(std::shared_ptr<SchemaContext> context,
+                    std::shared_ptr<Datastore> store)
+      : ctx(context), datastore(store) {}
 
-    void module_install(const char *module_name, const char *revision,
-                        sr_module_state_t state, void *private_ctx) override;
+    void install(const std::string &module,
+                 const std::string &revision) override;
 
-    void feature_enable(const char *module_name, const char *feature_name,
-                        bool enable, void *private_ctx) override;
-
-  private:
-    void install(const char *module_name, const char *revision);
+    void feature(const std::string &module, const std::string &feature,
+                 bool enable) override;
 
   private:
-    std::shared_ptr<libyang::Context> ctx;
-    std::shared_ptr<sysrepo::Session> sr_sess;
+    /* Not owned, the datastore owns its listeners and outlives Encode */
+    std::weak_ptr<SchemaContext> ctx;
+    std::weak_ptr<Datastore> datastore;
 };
 
 #endif //_RUNTIME_H
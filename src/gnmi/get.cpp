@@ -16,63 +16,125 @@
 
 #include <grpc/grpc.h>
 
+#include <proto/gnxi_ext.pb.h>
+
 #include "get.h"
 #include "encode/encode.h"
+#include "telemetry.h"
 #include <utils/utils.h>
 #include <utils/log.h>
+#include <utils/metrics.h>
 
 using namespace std;
 using google::protobuf::RepeatedPtrField;
-using sysrepo::sysrepo_exception;
 
 namespace impl {
 
+/*
+ * Add the update of a tree read for path.
+ * @return false once the response exceeds its size budget
+ */
+bool Get::AddUpdate(RepeatedPtrField<Update>* updateList, const Path *prefix,
+                    const Path &path, JsonData &it)
+{
+  Update *update = updateList->Add();
+  google::protobuf::Map<string, string> *key;
+  int idx;
+
+  /* Exact path of the tree if known */
+  if (!it.xpath.empty()) {
+    try {
+      compiler->parse(it.xpath, path, prefix, update->mutable_path());
+    } catch (invalid_argument &exc) {
+      GNXI_LOG(GET, warning) << exc.what();
+      it.xpath.clear();
+    }
+  }
+
+  if (it.xpath.empty()) {
+    update->mutable_path()->CopyFrom(path);
+
+    if (!it.key.first.empty()) {
+      GNXI_LOG(GET, debug) << "putting list entries key in gNMI path";
+      idx = update->mutable_path()->elem_size() - 1;
+      key = update->mutable_path()->mutable_elem(idx)->mutable_key();
+      (*key)[it.key.first] = it.key.second;
+    }
+  }
+
+  /* The encoded tree is moved, not copied, in the response */
+  update->mutable_val()->set_json_ietf_val(std::move(it.data));
+  response_size += update->ByteSizeLong();
+
+  /* Serve paths covered by path from the tree */
+  for (auto &covered : covering) {
+    Path covered_path;
+    string data;
+
+    if (!covered.resolved)
+      continue;
+    covered.resolved = json_extract(update->path(),
+                                    update->val().json_ietf_val(),
+                                    *covered.path, &covered_path, &data);
+    if (!covered.resolved || data.empty())
+      continue;
+
+    Update *extracted = covered.notification->add_update();
+    extracted->mutable_path()->Swap(&covered_path);
+    extracted->mutable_val()->set_json_ietf_val(std::move(data));
+    response_size += extracted->ByteSizeLong();
+  }
+
+  return max_size == 0 || response_size <= max_size;
+}
+
 Status
 Get::BuildGetUpdate(RepeatedPtrField<Update>* updateList,
-                            const Path &path, string fullpath,
-                            gnmi::Encoding encoding)
+                            const Path *prefix, const Path &path,
+                            const string &fullpath, gnmi::Encoding encoding)
 {
-  Update *update;
-  TypedValue *gnmival;
-  vector<JsonData> json_vec;
-  string *json_ietf;
-  int idx;
-  google::protobuf::Map<string, string> *key;
+  chrono::steady_clock::duration serialize(0);
 
   /* Refresh configuration data from current session */
-  sr_sess->refresh();
+  datastore->refresh();
+
+  /* Create new update message for every tree collected, as soon as it is
+   * read, so that the response is the only copy of the data */
+  auto add = [&](JsonData &it) {
+    auto start = chrono::steady_clock::now();
+    bool more = AddUpdate(updateList, prefix, path, it);
+    serialize += chrono::steady_clock::now() - start;
+    return more;
+  };
 
   /* Create appropriate TypedValue message based on encoding */
   switch (encoding) {
     case gnmi::JSON:
     case gnmi::JSON_IETF:
-      /* Get sysrepo subtree data corresponding to XPATH */
+      /* Get datastore subtree data corresponding to XPATH */
       try {
-        json_vec = encodef->json_read(fullpath);
+        if (Telemetry::match(fullpath)) {
+          for (auto &it : Telemetry::json_read(fullpath, *compiler))
+            if (!add(it))
+              break;
+        } else {
+          encodef->json_read(fullpath, add, read_options);
+        }
       } catch (invalid_argument &exc) {
         return Status(StatusCode::NOT_FOUND, exc.what());
-      } catch (sysrepo_exception &exc) {
-        BOOST_LOG_TRIVIAL(error) << "Fail getting items from sysrepo: "
-                                 << exc.what();
+      } catch (runtime_error &exc) {
+        GNXI_LOG(GET, error) << "Fail getting items from datastore: "
+                             << exc.what();
         return Status(StatusCode::INVALID_ARGUMENT, exc.what());
       }
-
-      /* Create new update message for every tree collected */
-      for (auto it : json_vec) {
-        update = updateList->Add();
-        update->mutable_path()->CopyFrom(path);
-
-        if (!it.key.first.empty()) {
-          BOOST_LOG_TRIVIAL(debug) << "putting list entries key in gNMI path";
-          idx = update->mutable_path()->elem_size() - 1;
-          key = update->mutable_path()->mutable_elem(idx)->mutable_key();
-          (*key)[it.key.first] = it.key.second;
-        }
-
-        gnmival = update->mutable_val();
-
-        json_ietf = gnmival->mutable_json_ietf_val();
-        *json_ietf = it.data;
+      Metrics::get().phase(Metrics::SERIALIZE).observe(serialize);
+
+      if (max_size > 0 && response_size > max_size) {
+        GNXI_LOG(GET, warning) << "GetResponse exceeds " << max_size
+                               << " bytes at " << fullpath;
+        return Status(StatusCode::RESOURCE_EXHAUSTED,
+                      "GetResponse exceeds " + to_string(max_size)
+                      + " bytes, use Subscribe ONCE to stream large data");
       }
 
       break;
@@ -100,28 +162,53 @@ Get::BuildGetNotification(Notification *notification, const Path *prefix,
 {
   /* Data elements that have changed values */
   RepeatedPtrField<Update>* updateList = notification->mutable_update();
-  string fullpath = "";
+  Xpath fullpath;
 
   /* Get time since epoch in milliseconds */
   notification->set_timestamp(get_time_nanosec());
 
   /* Put Request prefix as Response prefix */
-  if (prefix != nullptr) {
-    string str = gnmi_to_xpath(*prefix);
-    BOOST_LOG_TRIVIAL(debug) << "prefix is " << str;
+  if (prefix != nullptr)
     notification->mutable_prefix()->CopyFrom(*prefix);
-    fullpath += str;
-  }
 
-  fullpath += gnmi_to_xpath(path);
-  BOOST_LOG_TRIVIAL(debug) << "GetRequest Path " << fullpath;
+  try {
+    fullpath = compiler->compile(path, prefix);
+  } catch (invalid_argument &exc) {
+    return Status(StatusCode::INVALID_ARGUMENT, exc.what());
+  }
+  GNXI_LOG(GET, debug) << "GetRequest Path " << *fullpath;
+
+  /* Only read the descendants of path the client has access to */
+  if (authz) {
+    vector<Path> allowed;
+    switch (authz->check(user, prefix, path, Authorizer::READ, &allowed)) {
+      case Authorizer::DENY:
+        return Status(StatusCode::PERMISSION_DENIED,
+                      "Read access denied to " + *fullpath);
+      case Authorizer::PARTIAL:
+        for (auto &subpath : allowed) {
+          Status status;
+          try {
+            status = BuildGetUpdate(updateList, prefix, path,
+                                    *compiler->compile(subpath), encoding);
+          } catch (invalid_argument &exc) {
+            return Status(StatusCode::INVALID_ARGUMENT, exc.what());
+          }
+          if (!status.ok() && status.error_code() != StatusCode::NOT_FOUND)
+            return status;
+        }
+        return Status::OK;
+      case Authorizer::PERMIT:
+        break;
+    }
+  }
 
 
   /* TODO Check DATA TYPE in {ALL,CONFIG,STATE,OPERATIONAL}
    * This is interesting for NMDA architecture
    * req->type() : GetRequest_DataType_ALL,CONFIG,STATE,OPERATIONAL
    */
-  return BuildGetUpdate(updateList, path, fullpath, encoding);
+  return BuildGetUpdate(updateList, prefix, path, *fullpath, encoding);
 }
 
 /* Verify request fields are correct */
@@ -133,29 +220,59 @@ static inline Status verifyGetRequest(const GetRequest *request)
       break;
 
     default:
-      BOOST_LOG_TRIVIAL(warning) << "Unsupported Encoding "
-                                 << Encoding_Name(request->encoding());
+      GNXI_LOG(GET, warning) << "Unsupported Encoding "
+                             << Encoding_Name(request->encoding());
       return Status(StatusCode::UNIMPLEMENTED,
                     Encoding_Name(request->encoding()));
   }
 
   if (!GetRequest_DataType_IsValid(request->type())) {
-    BOOST_LOG_TRIVIAL(warning) << "Invalid Data Type in Get Request "
-                               << GetRequest_DataType_Name(request->type());
+    GNXI_LOG(GET, warning) << "Invalid Data Type in Get Request "
+                           << GetRequest_DataType_Name(request->type());
     return Status(StatusCode::UNIMPLEMENTED,
                   GetRequest_DataType_Name(request->type()));
   }
 
   if (request->use_models_size() > 0) {
-    BOOST_LOG_TRIVIAL(warning) << "use_models unsupported, ALL are used";
+    GNXI_LOG(GET, warning) << "use_models unsupported, ALL are used";
     return Status(StatusCode::UNIMPLEMENTED, "use_model feature unsupported");
   }
 
-  if (request->extension_size() > 0) {
-    BOOST_LOG_TRIVIAL(warning) << "extension unsupported";
+  return Status::OK;
+}
+
+/**
+ * Handles gNMI depth extension and gnxi_server experimental extension, other
+ * extensions are not supported. See proto/gnxi_ext.proto.
+ */
+Status Get::handleExtension(const gnmi_ext::Extension &extension)
+{
+  gnxi_ext::Experimental experimental;
+
+  if (extension.has_depth()) {
+    read_options.depth = extension.depth().level();
+    return Status::OK;
+  }
+
+  if (!extension.has_registered_ext()
+      || extension.registered_ext().id() != gnmi_ext::EID_EXPERIMENTAL) {
+    GNXI_LOG(GET, warning) << "extension unsupported";
     return Status(StatusCode::UNIMPLEMENTED, "extension feature unsupported");
   }
 
+  if (!experimental.ParseFromString(extension.registered_ext().msg()))
+    return Status(StatusCode::INVALID_ARGUMENT,
+                  "Invalid experimental extension");
+
+  if (experimental.has_aggregation() || experimental.has_sampling())
+    return Status(StatusCode::INVALID_ARGUMENT,
+                  "Aggregation and sampling require Subscribe STREAM mode");
+
+  if (experimental.has_pagination()) {
+    read_options.offset = experimental.pagination().offset();
+    read_options.limit = experimental.pagination().limit();
+  }
+
   return Status::OK;
 }
 
@@ -170,24 +287,79 @@ Status Get::run(const GetRequest* req, GetResponse* response)
   if (!status.ok())
     return status;
 
-  BOOST_LOG_TRIVIAL(debug) << "GetRequest DataType "
-                           << GetRequest::DataType_Name(req->type()) << ","
-                           << "GetRequest Encoding "
-                           << Encoding_Name(req->encoding());
+  for (auto &extension : req->extension()) {
+    status = handleExtension(extension);
+    if (!status.ok())
+      return status;
+  }
 
-  /* Run through all paths */
+  GNXI_LOG(GET, debug) << "GetRequest DataType "
+                       << GetRequest::DataType_Name(req->type()) << ","
+                       << "GetRequest Encoding "
+                       << Encoding_Name(req->encoding());
+
+  /* Paths covered by another path of the request are served from the
+   * updates read for the other path. Reads truncated by depth or pagination
+   * do not hold all the data of the paths they cover, and paths partially
+   * readable by the client are read with their own access rules. */
+  const Path *prefix = req->has_prefix() ? &req->prefix() : nullptr;
+  vector<bool> covered(req->path_size(), false);
+  if (read_options.whole()) {
+    vector<const Path*> paths;
+    for (auto &path : req->path())
+      paths.push_back(&path);
+    covered = covered_paths(paths);
+  }
+  for (int i = 0; i < req->path_size() && authz; i++)
+    if (covered[i] && authz->check(user, prefix, req->path(i),
+                                   Authorizer::READ) != Authorizer::PERMIT)
+      covered[i] = false;
+  vector<bool> pending(covered); //covered paths not served yet
+
+  /* Notifications are in the order of paths */
   notificationList = response->mutable_notification();
-  for (auto path : req->path()) {
-    notification = notificationList->Add();
+  for (int i = 0; i < req->path_size(); i++)
+    notificationList->Add();
+
+  /* Run through all paths not covered, with the paths they cover */
+  for (int i = 0; i < req->path_size(); i++) {
+    if (covered[i])
+      continue;
+
+    covering.clear();
+    for (int j = 0; j < req->path_size(); j++) {
+      if (pending[j] && path_covers(req->path(i), req->path(j))) {
+        covering.push_back({&req->path(j), notificationList->Mutable(j),
+                            true});
+        pending[j] = false;
+      }
+    }
 
-    if (req->has_prefix())
-      status = BuildGetNotification(notification, &req->prefix(), path, req->encoding());
-    else
-      status = BuildGetNotification(notification, nullptr, path, req->encoding());
+    status = BuildGetNotification(notificationList->Mutable(i), prefix,
+                                  req->path(i), req->encoding());
+
+    /* Covered paths not found in the updates are read */
+    for (auto &it : covering) {
+      if (!status.ok())
+        break;
+      notification = it.notification;
+      if (it.resolved && notification->update_size() > 0) {
+        GNXI_LOG(GET, debug) << "Path served by the updates of another path";
+        notification->set_timestamp(get_time_nanosec());
+        if (prefix != nullptr)
+          notification->mutable_prefix()->CopyFrom(*prefix);
+        continue;
+      }
+      notification->Clear();
+      status = BuildGetNotification(notification, prefix, *it.path,
+                                    req->encoding());
+    }
+    covering.clear();
 
     if (!status.ok()) {
-      BOOST_LOG_TRIVIAL(error) << "Fail building get notification: "
-                               << status.error_message();
+      GNXI_LOG(GET, error) << "Fail building get notification: "
+                           << status.error_message();
+      response->Clear(); //release memory before the RPC ends
       return status;
     }
   }
@@ -19,8 +19,10 @@
 
 #include <proto/gnmi.grpc.pb.h>
 
-#include <sysrepo-cpp/Session.hpp>
+#include <datastore/datastore.h>
 #include "encode/encode.h"
+#include <utils/xpath.h>
+#include <security/authorization.h>
 
 using namespace gnmi;
 using grpc::Status;
@@ -31,22 +33,47 @@ namespace impl {
 
 class Get {
   public:
-    Get(sysrepo::S_Session sess, std::shared_ptr<Encode> encode)
-      : sr_sess(sess), encodef(encode) {}
+    Get(std::shared_ptr<Datastore> store, std::shared_ptr<Encode> encode,
+        std::shared_ptr<PathCompiler> comp,
+        std::shared_ptr<Authorizer> authorizer = nullptr,
+        const std::string &username = "")
+      : datastore(store), encodef(encode), compiler(comp), authz(authorizer),
+        user(username), max_size(0), response_size(0) {}
     ~Get() {}
 
+    /* The whole GetResponse is built in memory, size bounds it: fail with
+     * RESOURCE_EXHAUSTED above size bytes, 0 for no limit */
+    void setMaxSize(size_t size) { max_size = size; }
+
     Status run(const GetRequest* req, GetResponse* response);
 
   private:
+    Status handleExtension(const gnmi_ext::Extension &extension);
     Status BuildGetNotification(Notification *notification, const Path *prefix,
                                 const Path &path, gnmi::Encoding encoding);
+    bool AddUpdate(RepeatedPtrField<Update>* updateList, const Path *prefix,
+                   const Path &path, JsonData &it);
     Status BuildGetUpdate(RepeatedPtrField<Update>* updateList,
-                          const Path &path, string fullpath,
-                          gnmi::Encoding encoding);
+                          const Path *prefix, const Path &path,
+                          const string &fullpath, gnmi::Encoding encoding);
+
+    /* Path of the request covered by the path being read */
+    struct CoveredPath {
+      const Path *path;
+      Notification *notification; //updates extracted for path
+      bool resolved; //false if path must be read
+    };
 
   private:
-    sysrepo::S_Session sr_sess; //sysrepo session
+    std::shared_ptr<Datastore> datastore; //data read and modified
     shared_ptr<Encode> encodef; //support for json ietf encoding
+    shared_ptr<PathCompiler> compiler; //gNMI path to xpath conversion
+    shared_ptr<Authorizer> authz; //access rules, nullptr if none
+    std::string user; //identity of client
+    size_t max_size; //size budget of the response in bytes
+    size_t response_size; //size of updates added to the response
+    ReadOptions read_options; //depth and pagination of reads
+    std::vector<CoveredPath> covering; //served by the path being read
 };
 
 }
@@ -14,38 +14,190 @@
  * limitations under the License.
  */
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include "gnmi.h"
 
 #include "get.h"
 #include "set.h"
 #include "subscribe.h"
+#include <utils/metrics.h>
 
 Status GNMIService::Set(ServerContext *context, const SetRequest* request,
                        SetResponse* response)
 {
-  (void)context;
-  impl::Set rpc(sr_sess, encodef);
+  impl::Set rpc(datastore, encodef, compiler, authz, peer_identity(context));
+  Metrics &metrics = Metrics::get();
+  Status status;
+
+  metrics.request(Metrics::SET);
+  {
+    LatencyTimer timer(metrics.duration(Metrics::SET));
+    status = rpc.run(request, response);
+  }
+  metrics.response(Metrics::SET, status.error_code());
+  if (status.ok()) {
+    size_t size = response->ByteSizeLong();
+    metrics.sent(Metrics::SET, size);
+    compression.apply(context, Compression::SET, size);
+  }
 
-  return rpc.run(request, response);
+  return status;
 }
 
 Status GNMIService::Get(ServerContext *context, const GetRequest* request,
                         GetResponse* response)
 {
-  (void)context;
-  impl::Get rpc(sr_sess, encodef);
+  impl::Get rpc(datastore, encodef, compiler, authz, peer_identity(context));
+  Metrics &metrics = Metrics::get();
+  Status status;
+
+  rpc.setMaxSize(max_get_size);
+
+  metrics.request(Metrics::GET);
+  {
+    LatencyTimer timer(metrics.duration(Metrics::GET));
+    status = rpc.run(request, response);
+  }
+  metrics.response(Metrics::GET, status.error_code());
+  if (status.ok()) {
+    size_t size = response->ByteSizeLong();
+    metrics.sent(Metrics::GET, size);
+    compression.apply(context, Compression::GET, size);
+  }
 
-  return rpc.run(request, response);
+  return status;
 }
 
-Status GNMIService::Subscribe(ServerContext* context,
-                 ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream)
+/*
+ * Serve a Subscribe RPC of the callback API in a thread of its own.
+ * impl::Subscribe reads and writes messages in blocking calls, which wait
+ * for the completion of the matching reaction. Cancellation of the RPC is
+ * signaled by gRPC in OnCancel, which terminates the subscription at once.
+ */
+class SubscribeReactor
+  : public ServerBidiReactor<SubscribeRequest, SubscribeResponse>,
+    public SubscribeStream
 {
-  SubscribeRequest request;
-  impl::Subscribe rpc(sr_sess, encodef);
+  public:
+    SubscribeReactor(CallbackServerContext *ctx,
+                     std::unique_ptr<impl::Subscribe> subscribe,
+                     std::atomic<int> &running)
+      : context(ctx), rpc(std::move(subscribe)), count(running),
+        reading(false), writing(false), read_ok(false), write_ok(false) {}
 
-  return rpc.run(context, stream);
+    /* Run the subscription, then finish the RPC with its status */
+    void start() { std::thread(&SubscribeReactor::run, this).detach(); }
 
-  return Status::OK;
-}
+    void SendInitialMetadata() override { StartSendInitialMetadata(); }
+
+    bool NextMessageSize(uint32_t *sz) override
+    {
+      *sz = UINT32_MAX;
+      return true;
+    }
+
+    /* Reactions may run inline in Start*, the lock is not held there */
+    bool Read(SubscribeRequest *msg) override
+    {
+      set(reading, true);
+      StartRead(msg);
+      return wait(reading, read_ok);
+    }
+
+    bool Write(const SubscribeResponse &msg, WriteOptions options) override
+    {
+      set(writing, true);
+      StartWrite(&msg, options);
+      return wait(writing, write_ok);
+    }
+
+    void OnReadDone(bool ok) override { done(reading, read_ok, ok); }
+    void OnWriteDone(bool ok) override { done(writing, write_ok, ok); }
+    void OnCancel() override { rpc->cancel(); }
+
+    void OnDone() override
+    {
+      count--;
+      delete this;
+    }
+
+  private:
+    void run()
+    {
+      Metrics &metrics = Metrics::get();
+      Status status;
 
+      metrics.streams().inc();
+      status = rpc->run(context, this);
+      metrics.streams().dec();
+      metrics.response(Metrics::SUBSCRIBE, status.error_code());
+
+      /* OnDone may delete this before Finish returns */
+      Finish(status);
+    }
+
+    void set(bool &pending, bool value)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      pending = value;
+    }
+
+    bool wait(bool &pending, bool &ok)
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [&pending]{ return !pending; });
+      return ok;
+    }
+
+    void done(bool &pending, bool &result, bool ok)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      pending = false;
+      result = ok;
+      cv.notify_all();
+    }
+
+  private:
+    CallbackServerContext *context; //context of the RPC
+    std::unique_ptr<impl::Subscribe> rpc; //subscription served
+    std::atomic<int> &count; //Subscribe RPCs not done yet
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool reading; //a Read is pending
+    bool writing; //a Write is pending
+    bool read_ok; //result of the last Read
+    bool write_ok; //result of the last Write
+};
+
+ServerBidiReactor<SubscribeRequest, SubscribeResponse>*
+GNMIService::Subscribe(CallbackServerContext* context)
+{
+  std::unique_ptr<impl::Subscribe> rpc(
+      new impl::Subscribe(datastore, encodef, compiler, compression, authz,
+                          peer_identity(context)));
+  Metrics &metrics = Metrics::get();
+  int running = ++subscriptions; //decremented by OnDone of the reactor
+
+  rpc->setMinInterval(min_sample_interval);
+  rpc->setChunkSize(chunk_size);
+
+  /* Latency of Subscribe is measured per sample, by impl::Subscribe */
+  metrics.request(Metrics::SUBSCRIBE);
+  auto reactor = new SubscribeReactor(context, std::move(rpc), subscriptions);
+
+  /* Subscriptions are not run by the server thread pool, they are bounded
+   * here rather than by the resource quota */
+  if (max_subscriptions > 0 && running > max_subscriptions) {
+    metrics.response(Metrics::SUBSCRIBE, StatusCode::RESOURCE_EXHAUSTED);
+    reactor->Finish(Status(StatusCode::RESOURCE_EXHAUSTED,
+                           "Too many Subscribe RPCs running"));
+  } else {
+    reactor->start();
+  }
+
+  return reactor;
+}
@@ -17,37 +17,58 @@
 #ifndef _GNMI_SERVER_H
 #define _GNMI_SERVER_H
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
 #include <proto/gnmi.grpc.pb.h>
 
-#include <sysrepo-cpp/Sysrepo.hpp>
-#include <sysrepo-cpp/Connection.hpp>
-#include <sysrepo-cpp/Session.hpp>
+#include <datastore/datastore.h>
 
 #include "encode/encode.h"
+#include <utils/xpath.h>
+#include "compression.h"
+#include "subscribe.h"
+#include <security/authorization.h>
 
 using namespace grpc;
 using namespace gnmi;
 
-using sysrepo::Session;
-using sysrepo::Connection;
 using google::protobuf::RepeatedPtrField;
 using std::make_shared;
 
-class GNMIService final : public gNMI::Service
+/* Subscribe is served with the callback API, the other RPCs by the
+ * synchronous server thread pool */
+class GNMIService final
+  : public gNMI::WithCallbackMethod_Subscribe<gNMI::Service>
 {
   public:
-    GNMIService(string app) {
-      try {
-        sr_con = make_shared<Connection>(app.c_str(), SR_CONN_DAEMON_REQUIRED);
-        sr_sess = make_shared<Session>(sr_con);
-        encodef = make_shared<Encode>(sr_sess);
-      } catch (sysrepo::sysrepo_exception &exc) {
-        std::cerr << "Connection to sysrepo failed " << exc.what() << std::endl;
-        exit(1);
-      }
+    GNMIService(shared_ptr<Datastore> store,
+                const Compression &compr = Compression(),
+                shared_ptr<Authorizer> authorizer = nullptr)
+      : datastore(store), compression(compr), authz(authorizer) {
+      encodef = make_shared<Encode>(datastore);
+      compiler = make_shared<PathCompiler>();
     }
     ~GNMIService() {std::cout << "Quitting GNMI Server" << std::endl; }
 
+    /* Lowest sample_interval accepted in STREAM subscriptions */
+    void setMinSampleInterval(std::chrono::nanoseconds interval)
+    {
+      min_sample_interval = interval;
+    }
+
+    /* GetResponse size budget in bytes, 0 for no limit */
+    void setMaxGetSize(size_t size) { max_get_size = size; }
+
+    /* Size of the Notifications large samples are split into, 0 to never
+     * split them */
+    void setChunkSize(size_t size) { chunk_size = size; }
+
+    /* Maximum number of Subscribe RPCs running at once, each one in a
+     * thread of its own, 0 for no limit */
+    void setMaxSubscriptions(int max) { max_subscriptions = max; }
+
     Status Capabilities(ServerContext* context,
         const CapabilityRequest* request, CapabilityResponse* response);
 
@@ -57,13 +78,29 @@ class GNMIService final : public gNMI::Service
     Status Set(ServerContext* context,
         const SetRequest* request, SetResponse* response);
 
-    Status Subscribe(ServerContext* context,
-        ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream);
+    ServerBidiReactor<SubscribeRequest, SubscribeResponse>*
+    Subscribe(CallbackServerContext* context) override;
+
+  private:
+    Status BuildCapabilityResponse(CapabilityResponse* response);
 
   private:
-    sysrepo::S_Connection sr_con; //sysrepo connection
-    sysrepo::S_Session sr_sess; //sysrepo session
+    shared_ptr<Datastore> datastore; //sysrepo or in-memory datastore
     shared_ptr<Encode> encodef; //support for json ietf encoding
+    shared_ptr<PathCompiler> compiler; //gNMI path to xpath conversion
+    Compression compression; //compression policy of responses
+    shared_ptr<Authorizer> authz; //access rules of users, nullptr if none
+    std::chrono::nanoseconds min_sample_interval = MIN_SAMPLE_INTERVAL;
+    size_t max_get_size = 0; //GetResponse size budget, 0 if unlimited
+    size_t chunk_size = NOTIFICATION_CHUNK_SIZE; //bytes per Notification
+    int max_subscriptions = 0; //running Subscribe RPCs, 0 if unlimited
+    std::atomic<int> subscriptions{0}; //Subscribe RPCs not done yet
+
+    /* CapabilityResponse cache, rebuilt when encodef schema version changes */
+    std::mutex cap_mutex;
+    CapabilityResponse cap_cache;
+    uint64_t cap_version = 0;
+    bool cap_valid = false;
 };
 
 #endif //_GNMI_SERVER_H
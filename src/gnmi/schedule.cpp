@@ -0,0 +1,78 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+#include "schedule.h"
+
+using namespace std;
+using namespace chrono;
+
+/* Number of clocks created since startup */
+static atomic<uint64_t> clocks(0);
+
+/* n-th point of the golden ratio sequence, in [0, 1) */
+static double golden(uint64_t n)
+{
+  double x = n * 0.6180339887498949;
+
+  return x - floor(x);
+}
+
+SampleClock::SampleClock(nanoseconds interval, bool aligned)
+  : period(interval)
+{
+  steady_clock::time_point now = steady_clock::now();
+  uint64_t since, phase;
+
+  if (period <= nanoseconds::zero())
+    throw invalid_argument("Sample interval must be greater than 0");
+
+  if (aligned) {
+    /* Wall-clock phase, the steady clock has no meaningful epoch */
+    since = duration_cast<nanoseconds>(system_clock::now()
+                                       .time_since_epoch()).count();
+    phase = 0;
+  } else {
+    /* Steady clock phase, every stream with the same interval and phase
+     * samples at the same time */
+    since = duration_cast<nanoseconds>(now.time_since_epoch()).count();
+    phase = golden(clocks++) * period.count();
+  }
+
+  /* First deadline after now, congruent to phase modulo period */
+  uint64_t offset = (phase + period.count() - since % period.count())
+                    % period.count();
+  if (offset == 0)
+    offset = period.count();
+
+  deadline = now + nanoseconds(offset);
+}
+
+uint64_t SampleClock::advance(steady_clock::time_point now)
+{
+  uint64_t skipped;
+
+  if (now < deadline)
+    return 0;
+
+  skipped = (now - deadline) / period;
+  deadline += period * (skipped + 1);
+
+  return skipped;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNMI_SCHEDULE_H
+#define _GNMI_SCHEDULE_H
+
+#include <chrono>
+#include <cstdint>
+
+/*
+ * SampleClock - Deadlines of a SAMPLE subscription, every interval from a
+ * phase. Subscriptions with the same interval would sample at the same time
+ * if they started together, so phases are spread over the interval: the n-th
+ * subscription of the server gets the n-th point of a golden ratio sequence,
+ * which keeps consecutive subscriptions as far apart as possible.
+ * Aligned clocks sample on multiples of the interval in wall-clock time
+ * instead, e.g. at every round minute, for collectors correlating samples of
+ * several targets.
+ */
+class SampleClock {
+  public:
+    /*
+     * @param interval time between samples
+     * @param aligned sample on wall-clock multiples of interval
+     */
+    SampleClock(std::chrono::nanoseconds interval, bool aligned = false);
+    ~SampleClock() {}
+
+    std::chrono::steady_clock::time_point next() const { return deadline; }
+    bool due(std::chrono::steady_clock::time_point now) const
+    {
+      return now >= deadline;
+    }
+
+    /*
+     * Move to the first deadline after now.
+     * @return number of deadlines skipped, whose sample is lost
+     */
+    uint64_t advance(std::chrono::steady_clock::time_point now);
+
+  private:
+    std::chrono::nanoseconds period;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+#endif //_GNMI_SCHEDULE_H
@@ -14,52 +14,83 @@
  * limitations under the License.
  */
 
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
 #include "set.h"
 #include "encode/encode.h"
 #include <utils/utils.h>
 #include <utils/log.h>
 
-using namespace sysrepo;
 using namespace std;
 
 namespace impl {
 
-StatusCode Set::handleUpdate(Update in, UpdateResult *out, string prefix)
+/*
+ * Decimal notation of a float, with enough significant digits to read the
+ * same float back. Scientific notation is rejected by decimal64 leaves.
+ */
+static string float_str(float val)
+{
+  const int digits = numeric_limits<float>::max_digits10;
+  ostringstream num;
+  string str;
+  int exponent;
+
+  num << setprecision(digits) << val;
+  str = num.str();
+  if (str.find_first_of("eE") == string::npos || !isfinite(val))
+    return str;
+
+  /* digits significant digits after the decimal point */
+  exponent = static_cast<int>(floor(log10(fabs(val))));
+  num.str("");
+  num << fixed << setprecision(max(0, digits - 1 - exponent)) << val;
+  str = num.str();
+
+  if (str.find('.') != string::npos) {
+    str.erase(str.find_last_not_of('0') + 1);
+    if (str.back() == '.')
+      str.pop_back();
+  }
+
+  return str;
+}
+
+StatusCode Set::handleUpdate(Update in, UpdateResult *out, const Path *prefix)
 {
-  shared_ptr<Val> sval;
+
   //Parse request
   if (!in.has_path() || !in.has_val()) {
-    BOOST_LOG_TRIVIAL(error) << "Update no path or value";
+    GNXI_LOG(SET, error) << "Update no path or value";
     return StatusCode::INVALID_ARGUMENT;
   }
 
-  string fullpath = prefix + gnmi_to_xpath(in.path());
+  string fullpath = *compiler->compile(in.path(), prefix);
   TypedValue reqval = in.val();
-  BOOST_LOG_TRIVIAL(debug) << "Update" << fullpath;
+  GNXI_LOG(SET, debug) << "Update" << fullpath;
 
+  /* Scalar values are converted to the type of the leaf by the datastore */
   switch (reqval.value_case()) {
     case gnmi::TypedValue::ValueCase::kStringVal: /* No encoding */
-      sval = make_shared<Val>(reqval.string_val().c_str());
-      sr_sess->set_item(fullpath.c_str(), sval);
+      datastore->set(fullpath, reqval.string_val().c_str());
       break;
     case gnmi::TypedValue::ValueCase::kIntVal: /* No Encoding */
-      sval = make_shared<Val>(reqval.int_val(), SR_INT64_T);
-      sr_sess->set_item(fullpath.c_str(), sval);
+      datastore->set(fullpath, to_string(reqval.int_val()).c_str());
       break;
     case gnmi::TypedValue::ValueCase::kUintVal: /* No Encoding */
-      sval = make_shared<Val>(reqval.uint_val(), SR_UINT64_T);
-      sr_sess->set_item(fullpath.c_str(), sval);
+      datastore->set(fullpath, to_string(reqval.uint_val()).c_str());
       break;
     case gnmi::TypedValue::ValueCase::kBoolVal: /* No Encoding */
-      sval = make_shared<Val>(reqval.bool_val());
-      sr_sess->set_item(fullpath.c_str(), sval);
+      datastore->set(fullpath, reqval.bool_val() ? "true" : "false");
       break;
     case gnmi::TypedValue::ValueCase::kBytesVal:
       throw std::invalid_argument("Unsupported BYTES Encoding");
       return StatusCode::UNIMPLEMENTED;
     case gnmi::TypedValue::ValueCase::kFloatVal:
-      sval = make_shared<Val>(static_cast<double>(reqval.float_val()));
-      sr_sess->set_item(fullpath.c_str(), sval);
+      datastore->set(fullpath, float_str(reqval.float_val()).c_str());
       break;
     case gnmi::TypedValue::ValueCase::kDecimalVal: /* No Encoding */
       throw std::invalid_argument("Unsupported Decimal64 type");
@@ -75,7 +106,17 @@ StatusCode Set::handleUpdate(Update in, UpdateResult *out, string prefix)
       return StatusCode::UNIMPLEMENTED;
     case gnmi::TypedValue::ValueCase::kJsonIetfVal:
       try {
-        encodef->json_update(reqval.json_ietf_val());
+        /* JSON document can hold data out of the update path */
+        function<void(const string&)> check;
+        if (authz)
+          check = [this](const string &xpath) {
+            Path path;
+            compiler->parse(xpath, &path);
+            if (authz->check(user, nullptr, path, Authorizer::WRITE)
+                != Authorizer::PERMIT)
+              throw permission_denied("Write access denied to " + xpath);
+          };
+        encodef->json_update(reqval.json_ietf_val(), check);
       } catch (runtime_error &err) {
         //wrong input field must reply an error to gnmi client
         throw std::invalid_argument(err.what());
@@ -105,12 +146,33 @@ StatusCode Set::handleUpdate(Update in, UpdateResult *out, string prefix)
   return StatusCode::OK;
 }
 
+/* Check every path of request is writable by the client */
+Status Set::authorize(const SetRequest* request, const Path *prefix)
+{
+  auto check = [&](const Path &path) {
+    return authz->check(user, prefix, path, Authorizer::WRITE)
+           == Authorizer::PERMIT;
+  };
+
+  for (auto &delpath : request->delete_())
+    if (!check(delpath))
+      return Status(StatusCode::PERMISSION_DENIED, "Write access denied");
+  for (auto &upd : request->replace())
+    if (!check(upd.path()))
+      return Status(StatusCode::PERMISSION_DENIED, "Write access denied");
+  for (auto &upd : request->update())
+    if (!check(upd.path()))
+      return Status(StatusCode::PERMISSION_DENIED, "Write access denied");
+
+  return Status::OK;
+}
+
 Status Set::run(const SetRequest* request, SetResponse* response)
 {
-  std::string prefix = "";
+  const Path *prefix = nullptr;
 
   if (request->extension_size() > 0) {
-    BOOST_LOG_TRIVIAL(error) << "Extensions not implemented";
+    GNXI_LOG(SET, error) << "Extensions not implemented";
     return Status(StatusCode::UNIMPLEMENTED, "Extensions not implemented");
   }
 
@@ -118,21 +180,36 @@ Status Set::run(const SetRequest* request, SetResponse* response)
 
   /* Prefix for gNMI path */
   if (request->has_prefix()) {
-    prefix = gnmi_to_xpath(request->prefix());
-    BOOST_LOG_TRIVIAL(debug) << "prefix is " << prefix;
+    prefix = &request->prefix();
     response->mutable_prefix()->CopyFrom(request->prefix());
   }
 
+  /* Rights of client are checked before any change in the datastore */
+  if (authz) {
+    Status status = authorize(request, prefix);
+    if (!status.ok()) {
+      GNXI_LOG(SET, warning) << status.error_message() << " for " << user;
+      return status;
+    }
+  }
+
+  /* Changes are discarded on every error, before the datastore is released
+   * to the next Set */
+  Transaction transaction(datastore);
+
   /* gNMI paths to delete */
   if (request->delete__size() > 0) {
     for (auto delpath : request->delete_()) {
-      //Parse request and config sysrepo
-      string fullpath = prefix + gnmi_to_xpath(delpath);
-      BOOST_LOG_TRIVIAL(debug) << "Delete " << fullpath;
+      //Parse request and config the datastore
       try {
-        sr_sess->delete_item(fullpath.c_str()); //EDIT_DEFAULT option
+        Xpath fullpath = compiler->compile(delpath, prefix);
+        GNXI_LOG(SET, debug) << "Delete " << *fullpath;
+        datastore->remove(*fullpath);
+      } catch (const invalid_argument &exc) {
+        GNXI_LOG(SET, error) << exc.what();
+        return Status(StatusCode::INVALID_ARGUMENT, exc.what());
       } catch (const exception &exc) {
-        BOOST_LOG_TRIVIAL(error) << exc.what();
+        GNXI_LOG(SET, error) << exc.what();
         return Status(StatusCode::INTERNAL, "delete item failed");
       }
       //Fill in Reponse
@@ -148,14 +225,17 @@ Status Set::run(const SetRequest* request, SetResponse* response)
       UpdateResult* res = response->add_response();
       try {
         handleUpdate(upd, res, prefix);
+      } catch (const permission_denied &exc) {
+        GNXI_LOG(SET, warning) << exc.what() << " for " << user;
+        return Status(StatusCode::PERMISSION_DENIED, exc.what());
       } catch (const invalid_argument &exc) {
-        BOOST_LOG_TRIVIAL(error) << exc.what();
+        GNXI_LOG(SET, error) << exc.what();
         return Status(StatusCode::INVALID_ARGUMENT, exc.what());
-      } catch (const sysrepo_exception &exc) {
-        BOOST_LOG_TRIVIAL(error) << exc.what();
+      } catch (const runtime_error &exc) {
+        GNXI_LOG(SET, error) << exc.what();
         return Status(StatusCode::INTERNAL, exc.what());
       } catch (const exception &exc) { //Any other exception
-        BOOST_LOG_TRIVIAL(error) << exc.what();
+        GNXI_LOG(SET, error) << exc.what();
         return Status(StatusCode::INTERNAL, exc.what());
       }
       res->set_op(gnmi::UpdateResult::REPLACE);
@@ -168,11 +248,14 @@ Status Set::run(const SetRequest* request, SetResponse* response)
       UpdateResult* res = response->add_response();
       try {
         handleUpdate(upd, res, prefix);
+      } catch (const permission_denied &exc) {
+        GNXI_LOG(SET, warning) << exc.what() << " for " << user;
+        return Status(StatusCode::PERMISSION_DENIED, exc.what());
       } catch (const invalid_argument &exc) {
-        BOOST_LOG_TRIVIAL(error) << exc.what();
+        GNXI_LOG(SET, error) << exc.what();
         return Status(StatusCode::INVALID_ARGUMENT, exc.what());
-      } catch (const sysrepo_exception &exc) {
-        BOOST_LOG_TRIVIAL(error) << exc.what();
+      } catch (const runtime_error &exc) {
+        GNXI_LOG(SET, error) << exc.what();
         return Status(StatusCode::INTERNAL, exc.what());
       }
       res->set_op(gnmi::UpdateResult::UPDATE);
@@ -180,9 +263,9 @@ Status Set::run(const SetRequest* request, SetResponse* response)
   }
 
   try {
-    sr_sess->commit();
+    transaction.commit();
   } catch (const exception &exc) {
-    BOOST_LOG_TRIVIAL(error) << exc.what();
+    GNXI_LOG(SET, error) << exc.what();
     return Status(StatusCode::INTERNAL, "commit failed");
   }
 
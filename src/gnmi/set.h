@@ -19,8 +19,10 @@
 
 #include <proto/gnmi.grpc.pb.h>
 
-#include <sysrepo-cpp/Session.hpp>
+#include <datastore/datastore.h>
 #include "encode/encode.h"
+#include <utils/xpath.h>
+#include <security/authorization.h>
 
 using namespace gnmi;
 using grpc::Status;
@@ -30,18 +32,26 @@ namespace impl {
 
 class Set {
   public:
-    Set(sysrepo::S_Session sess, std::shared_ptr<Encode> encode)
-      : sr_sess(sess), encodef(encode) {}
+    Set(std::shared_ptr<Datastore> store, std::shared_ptr<Encode> encode,
+        std::shared_ptr<PathCompiler> comp,
+        std::shared_ptr<Authorizer> authorizer = nullptr,
+        const std::string &username = "")
+      : datastore(store), encodef(encode), compiler(comp), authz(authorizer),
+        user(username) {}
     ~Set() {}
 
     Status run(const SetRequest* request, SetResponse* response);
 
   private:
-    StatusCode handleUpdate(Update in, UpdateResult *out, string prefix);
+    StatusCode handleUpdate(Update in, UpdateResult *out, const Path *prefix);
+    Status authorize(const SetRequest* request, const Path *prefix);
 
   private:
-    sysrepo::S_Session sr_sess; //sysrepo session
+    std::shared_ptr<Datastore> datastore; //data read and modified
     shared_ptr<Encode> encodef; //support for json ietf encoding
+    shared_ptr<PathCompiler> compiler; //gNMI path to xpath conversion
+    shared_ptr<Authorizer> authz; //access rules, nullptr if none
+    std::string user; //identity of client
 };
 
 }
@@ -22,73 +22,163 @@
 #include <grpc/grpc.h>
 
 #include "subscribe.h"
+#include "schedule.h"
+#include "telemetry.h"
 #include <utils/utils.h>
 #include <utils/log.h>
+#include <utils/metrics.h>
 
 using namespace std;
 using namespace chrono;
 using google::protobuf::RepeatedPtrField;
-using sysrepo::sysrepo_exception;
 
 namespace impl {
 
-Status
-Subscribe::BuildSubsUpdate(RepeatedPtrField<Update>* updateList,
-                            const Path &path, string fullpath,
-                            gnmi::Encoding encoding)
+/*
+ * Add the update of a tree read for path to notification.
+ * @return false if a chunk of notification could not be written to stream
+ */
+bool Subscribe::AddUpdate(Notification *notification, const Path *prefix,
+    const Path &path, JsonData &it,
+    SubscribeStream* stream)
 {
-  Update *update;
-  TypedValue *gnmival;
-  vector<JsonData> json_vec;
-  string *json_ietf;
-  int idx;
+  Update *update = notification->add_update();
   google::protobuf::Map<string, string> *key;
+  int idx;
+
+  /* Exact path of the tree if known */
+  if (!it.xpath.empty()) {
+    try {
+      compiler->parse(it.xpath, path, prefix, update->mutable_path());
+    } catch (invalid_argument &exc) {
+      GNXI_LOG(SUBSCRIBE, warning) << exc.what();
+      it.xpath.clear();
+    }
+  }
+
+  if (it.xpath.empty()) {
+    update->mutable_path()->CopyFrom(path);
+
+    if (!it.key.first.empty()) {
+      GNXI_LOG(SUBSCRIBE, debug) << "putting list entries key in gNMI path";
+      idx = update->mutable_path()->elem_size() - 1;
+      key = update->mutable_path()->mutable_elem(idx)->mutable_key();
+      (*key)[it.key.first] = it.key.second;
+    }
+  }
+
+  /* The encoded tree is moved, not copied, in the notification */
+  update->mutable_val()->set_json_ietf_val(std::move(it.data));
+
+  /* Serve paths covered by path from the tree, before it is written */
+  for (auto &covered : covering) {
+    Path covered_path;
+    string data;
+
+    if (!covered.resolved)
+      continue;
+    covered.resolved = json_extract(update->path(),
+                                    update->val().json_ietf_val(),
+                                    *covered.path, &covered_path, &data);
+    if (!covered.resolved || data.empty())
+      continue;
+
+    covered.updates.emplace_back();
+    covered.updates.back().mutable_path()->Swap(&covered_path);
+    covered.updates.back().mutable_val()->set_json_ietf_val(std::move(data));
+  }
+
+  return AddChunk(notification, update->ByteSizeLong(), stream);
+}
+
+/*
+ * Count bytes of an update added to notification, write the updates of
+ * notification as a chunk once they reach the chunk size.
+ * @return false if the chunk could not be written to stream
+ */
+bool Subscribe::AddChunk(Notification *notification, size_t bytes,
+    SubscribeStream* stream)
+{
+  chunk_bytes += bytes;
+  if (stream == nullptr || chunk_size == 0 || chunk_bytes < chunk_size)
+    return true;
+
+  return WriteChunk(notification, stream);
+}
+
+/*
+ * Write the updates of notification in a Notification of their own, keep
+ * the timestamp and prefix of notification for the next updates.
+ */
+bool Subscribe::WriteChunk(Notification *notification,
+    SubscribeStream* stream)
+{
+  SubscribeResponse response;
 
-  /* Create Update message */
-  update = updateList->Add();
-  update->mutable_path()->CopyFrom(path);
-  gnmival = update->mutable_val();
+  response.mutable_update()->Swap(notification);
+  notification->set_timestamp(response.update().timestamp());
+  if (response.update().has_prefix())
+    notification->mutable_prefix()->CopyFrom(response.update().prefix());
+  chunk_bytes = 0;
+
+  GNXI_LOG(SUBSCRIBE, debug) << "Write chunk of "
+                             << response.update().update_size() << " updates";
+
+  return Write(stream, response);
+}
+
+Status
+Subscribe::BuildSubsUpdate(Notification *notification,
+    const Path *prefix, const Path &path,
+    const string &fullpath, gnmi::Encoding encoding,
+    SubscribeStream* stream)
+{
+  chrono::steady_clock::duration serialize(0);
+  bool written = true;
 
   /* Refresh configuration data from current session */
-  sr_sess->refresh();
+  datastore->refresh();
+
+  /* Create new update message for every tree collected, as soon as it is
+   * read. Large notifications are written in chunks on the way, so that
+   * memory does not grow with the size of the subtree */
+  auto add = [&](JsonData &it) {
+    auto start = chrono::steady_clock::now();
+    written = AddUpdate(notification, prefix, path, it, stream);
+    serialize += chrono::steady_clock::now() - start;
+    return written;
+  };
 
   /* Create appropriate TypedValue message based on encoding */
   switch (encoding) {
     case gnmi::JSON:
     case gnmi::JSON_IETF:
-      /* Get sysrepo subtree data corresponding to XPATH */
+      /* Get datastore subtree data corresponding to XPATH */
       try {
-        json_vec = encodef->json_read(fullpath);
+        if (Telemetry::match(fullpath)) {
+          for (auto &it : Telemetry::json_read(fullpath, *compiler))
+            if (!add(it))
+              break;
+        } else {
+          encodef->json_read(fullpath, add, read_options);
+        }
       } catch (invalid_argument &exc) {
         return Status(StatusCode::NOT_FOUND, exc.what());
-      } catch (sysrepo_exception &exc) {
-        BOOST_LOG_TRIVIAL(error) << "Fail getting items from sysrepo: "
-                                 << exc.what();
+      } catch (runtime_error &exc) {
+        GNXI_LOG(SUBSCRIBE, error) << "Fail getting items from datastore: "
+                                   << exc.what();
         return Status(StatusCode::INVALID_ARGUMENT, exc.what());
       }
+      Metrics::get().phase(Metrics::SERIALIZE).observe(serialize);
 
-      /* Create new update message for every tree collected */
-      for (auto it : json_vec) {
-        update = updateList->Add();
-        update->mutable_path()->CopyFrom(path);
-
-        if (!it.key.first.empty()) {
-          BOOST_LOG_TRIVIAL(debug) << "putting list entries key in gNMI path";
-          idx = update->mutable_path()->elem_size() - 1;
-          key = update->mutable_path()->mutable_elem(idx)->mutable_key();
-          (*key)[it.key.first] = it.key.second;
-        }
-
-        gnmival = update->mutable_val();
-
-        json_ietf = gnmival->mutable_json_ietf_val();
-        *json_ietf = it.data;
-      }
+      if (!written)
+        return Status(StatusCode::CANCELLED, "Subscribe stream closed");
 
       break;
 
     case gnmi::PROTO:
-      BOOST_LOG_TRIVIAL(error) << "Deviation from specification, Unsupported Yet";
+      GNXI_LOG(SUBSCRIBE, error)
+        << "Deviation from specification, Unsupported Yet";
       break;
 
     default:
@@ -98,86 +188,210 @@ Subscribe::BuildSubsUpdate(RepeatedPtrField<Update>* updateList,
   return Status::OK;
 }
 
+/*
+ * Add the updates of one subscription path to notification, with the data
+ * the client has access to.
+ */
+Status
+Subscribe::BuildSubsPath(Notification *notification,
+    const Path *prefix, const Path &path, gnmi::Encoding encoding,
+    SubscribeStream* stream)
+{
+  Status status;
+  Xpath fullpath;
+
+  try {
+    fullpath = compiler->compile(path, prefix);
+  } catch (invalid_argument &exc) {
+    return Status(StatusCode::INVALID_ARGUMENT, exc.what());
+  }
+
+  // Only sample the descendants of path the client has access to
+  vector<Path> allowed;
+  Authorizer::Decision access = Authorizer::PERMIT;
+  if (authz)
+    access = authz->check(user, prefix, path, Authorizer::READ, &allowed);
+
+  switch (access) {
+    case Authorizer::DENY:
+      return Status(StatusCode::PERMISSION_DENIED,
+                    "Read access denied to " + *fullpath);
+    case Authorizer::PARTIAL:
+      for (auto &subpath : allowed) {
+        try {
+          status = BuildSubsUpdate(notification, prefix, path,
+                                   *compiler->compile(subpath), encoding,
+                                   stream);
+        } catch (invalid_argument &exc) {
+          return Status(StatusCode::INVALID_ARGUMENT, exc.what());
+        }
+        if (!status.ok() && status.error_code() != StatusCode::NOT_FOUND)
+          return status;
+      }
+      break;
+    case Authorizer::PERMIT:
+      // Fetch all found counters value for a requested path
+      status = BuildSubsUpdate(notification, prefix, path, *fullpath,
+                               encoding, stream);
+      if (!status.ok()) {
+        GNXI_LOG(SUBSCRIBE, error) << "Fail building update for "
+                                   << *fullpath;
+        return status;
+      }
+      break;
+  }
+
+  return Status::OK;
+}
+
 /**
  * BuildSubscribeNotification - Build a Notification message.
  * Contrary to Get Notification, gnmi specification highly recommands to
  * put multiple <xpath, value> in the same Notification message.
  * @param notification the notification that is constructed by this function.
  * @param request the SubscriptionList from SubscribeRequest to answer to.
+ * @param stream if set, updates above chunk size are written to stream in
+ *               Notifications of their own, notification holds the rest.
  */
 Status
 Subscribe::BuildSubscribeNotification(Notification *notification,
-                                      const SubscriptionList& request)
+    const SubscriptionList& request,
+    SubscribeStream* stream)
 {
-  RepeatedPtrField<Update>* updateList = notification->mutable_update();
+  LatencyTimer timer(Metrics::get().duration(Metrics::SUBSCRIBE));
+  LatencyTimer sample_timer(stats->latency);
   Status status;
 
   switch (request.encoding()) {
     case gnmi::JSON:
     case gnmi::JSON_IETF:
-      BOOST_LOG_TRIVIAL(debug) << "JSON IETF";
+      GNXI_LOG(SUBSCRIBE, debug) << "JSON IETF";
       break;
 
     case gnmi::PROTO:
-      BOOST_LOG_TRIVIAL(error) << "PROTO encoding will soon be supported";
+      GNXI_LOG(SUBSCRIBE, error) << "PROTO encoding will soon be supported";
       return Status(StatusCode::UNIMPLEMENTED, Encoding_Name(request.encoding()));
       break;
 
     default:
-      BOOST_LOG_TRIVIAL(warning) << "Unsupported Encoding "
-                                 << Encoding_Name(request.encoding());
+      GNXI_LOG(SUBSCRIBE, warning) << "Unsupported Encoding "
+                                   << Encoding_Name(request.encoding());
       return Status(StatusCode::UNIMPLEMENTED, Encoding_Name(request.encoding()));
   }
 
   // Defined refer to a long Path by a shorter one: alias
   if (request.use_aliases()) {
-    BOOST_LOG_TRIVIAL(warning) << "Unsupported usage of aliases";
+    GNXI_LOG(SUBSCRIBE, warning) << "Unsupported usage of aliases";
     return Status(StatusCode::UNIMPLEMENTED, "alias not supported");
   }
 
   /* Check if only updates should be sent */
   if (request.updates_only())
-    BOOST_LOG_TRIVIAL(warning) << "Unsupported updates_only, send all paths";
+    GNXI_LOG(SUBSCRIBE, warning) << "Unsupported updates_only, send all paths";
 
   /* Get time since epoch in milliseconds */
   notification->set_timestamp(get_time_nanosec());
 
   if (request.has_prefix())
     notification->mutable_prefix()->CopyFrom(request.prefix());
+  chunk_bytes = 0;
 
   /* Fill Update RepeatedPtrField in Notification message
    * Update field contains only data elements that have changed values. */
+  const Path *prefix = request.has_prefix() ? &request.prefix() : nullptr;
+
+  /* Subscriptions covered by another one are served from the updates
+   * read for the other one. Reads truncated by depth or pagination do not
+   * hold all the data of the paths they cover, and paths partially
+   * readable by the client are read with their own access rules. */
+  vector<bool> covered(request.subscription_size(), false);
+  if (read_options.whole()) {
+    vector<const Path*> paths;
+    for (auto &sub : request.subscription())
+      paths.push_back(&sub.path());
+    covered = covered_paths(paths);
+  }
+  for (int i = 0; i < request.subscription_size() && authz; i++)
+    if (covered[i] && authz->check(user, prefix, request.subscription(i).path(),
+                                   Authorizer::READ) != Authorizer::PERMIT)
+      covered[i] = false;
+  vector<bool> pending(covered); //covered paths not served yet
+
   for (int i = 0; i < request.subscription_size(); i++) {
-    Subscription sub = request.subscription(i);
-
-    // Fetch all found counters value for a requested path
-    status = BuildSubsUpdate(updateList, sub.path(), gnmi_to_xpath(sub.path()),
-                             request.encoding());
-    if (!status.ok()) {
-      BOOST_LOG_TRIVIAL(error) << "Fail building update for "
-                               << gnmi_to_xpath(sub.path());
-      return status;
+    vector<CoveredPath> served;
+
+    if (covered[i])
+      continue;
+
+    covering.clear();
+    for (int j = 0; j < request.subscription_size(); j++) {
+      const Path &path = request.subscription(j).path();
+      if (pending[j] && path_covers(request.subscription(i).path(), path)) {
+        covering.push_back({&path, true, {}});
+        pending[j] = false;
+      }
     }
+
+    status = BuildSubsPath(notification, prefix,
+                           request.subscription(i).path(), request.encoding(),
+                           stream);
+    served.swap(covering);
+
+    /* Covered paths not found in the updates are read */
+    for (auto &it : served) {
+      if (!status.ok())
+        break;
+      if (!it.resolved || it.updates.empty()) {
+        status = BuildSubsPath(notification, prefix, *it.path,
+                               request.encoding(), stream);
+        continue;
+      }
+
+      GNXI_LOG(SUBSCRIBE, debug) << "Path served by the updates of another "
+                                 << "path";
+      for (auto &update : it.updates) {
+        Update *added = notification->add_update();
+        added->Swap(&update);
+        if (!AddChunk(notification, added->ByteSizeLong(), stream)) {
+          status = Status(StatusCode::CANCELLED, "Subscribe stream closed");
+          break;
+        }
+      }
+    }
+
+    if (!status.ok())
+      return status;
   }
 
   notification->set_atomic(false);
+  stats->samples.inc();
 
   return Status::OK;
 }
 
+/* Wake up the sampling loop of a STREAM subscription, which then returns */
+void Subscribe::cancel()
+{
+  events.terminate();
+}
+
 /**
  * Handles SubscribeRequest messages with STREAM subscription mode by
  * periodically sending updates to the client.
+ * The sampling loop sleeps on StreamEvents, cancel() terminates it when the
+ * RPC is cancelled. Messages sent by the client after the SubscriptionList
+ * are not read. Errors of samples end the RPC with their status.
  */
 Status Subscribe::handleStream(
-    ServerContext* context, SubscribeRequest request,
-    ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream)
+    ServerContextBase* context, SubscribeRequest request,
+    SubscribeStream* stream)
 {
   SubscribeResponse response;
   Status status;
 
   // Checks that sample_interval values are not higher than INT64_MAX
-  // i.e. 9223372036854775807 nanoseconds
+  // i.e. 9223372036854775807 nanoseconds, nor lower than the minimum
+  // interval: they would silently be sampled less often than requested
   for (int i = 0; i < request.subscribe().subscription_size(); i++) {
     Subscription sub = request.subscribe().subscription(i);
     if (sub.sample_interval() > duration<long long, std::nano>::max().count()) {
@@ -186,35 +400,49 @@ Status Subscribe::handleStream(
                     string("sample_interval must be less than ")
                     + to_string(INT64_MAX) + " nanoseconds");
     }
+    if (sub.mode() == SAMPLE && sub.sample_interval() > 0
+        && nanoseconds(sub.sample_interval()) < min_interval) {
+      context->TryCancel();
+      return Status(StatusCode::INVALID_ARGUMENT,
+                    string("sample_interval must be at least ")
+                    + to_string(min_interval.count()) + " nanoseconds");
+    }
   }
 
   // Sends a first Notification message that updates all Subcriptions
   status = BuildSubscribeNotification(response.mutable_update(),
-                                      request.subscribe());
+                                      request.subscribe(), stream);
   if (!status.ok()) {
     context->TryCancel();
     return status;
   }
-  stream->Write(response);
+  Write(stream, response);
   response.Clear();
 
   // Sends a SYNC message that indicates that initial synchronization
   // has completed, i.e. each Subscription has been updated once
   response.set_sync_response(true);
-  stream->Write(response);
+  Write(stream, response);
   response.Clear();
 
   // We use a vector of pairs instead of a map as we are going to iterate more
   // than we are going to retrieve specific keys.
-  vector<pair<Subscription, time_point<high_resolution_clock>>> chronomap;
+  // Every subscription samples on its own clock, phases are spread over
+  // the interval unless the client asked for wall-clock alignment.
+  // An interval of 0 is the lowest interval supported.
+  vector<pair<Subscription, SampleClock>> chronomap;
   for (int i=0; i<request.subscribe().subscription_size(); i++) {
     Subscription sub = request.subscribe().subscription(i);
+    nanoseconds interval(sub.sample_interval());
     switch (sub.mode()) {
       case SAMPLE:
-        chronomap.emplace_back(sub, high_resolution_clock::now());
+        if (interval == nanoseconds::zero())
+          interval = min_interval;
+        stats->intervals.push_back(interval.count());
+        chronomap.emplace_back(sub, SampleClock(interval, aligned));
         break;
       default:
-        BOOST_LOG_TRIVIAL(warning) << "Unsupported mode";
+        GNXI_LOG(SUBSCRIBE, warning) << "Unsupported mode";
         // TODO: Handle ON_CHANGE and TARGET_DEFINED modes
         // Ref: 3.5.1.5.2
         break;
@@ -225,67 +453,104 @@ Status Subscribe::handleStream(
    * Note : There is only one Path per Subscription, but repeated
    * Subscriptions in a SubscriptionList, each Subscription can
    * have its own sample interval */
-  while(!context->IsCancelled()) {
-    auto start = high_resolution_clock::now();
+  steady_clock::time_point window_end = steady_clock::now();
+
+  if (aggregator != nullptr)
+    window_end += nanoseconds(aggregator->window());
+
+  while (!events.terminated()) {
+    auto start = steady_clock::now();
 
     SubscribeRequest updateRequest(request);
     SubscriptionList* updateList(updateRequest.mutable_subscribe());
     updateList->clear_subscription();
 
     for (auto& pair : chronomap) {
-      duration<long long, std::nano> duration =
-        high_resolution_clock::now()-pair.second;
-      if (duration > nanoseconds{pair.first.sample_interval()}) {
-        pair.second = high_resolution_clock::now();
+      if (pair.second.due(start)) {
+        /* Samples of the deadlines missed since the previous one are lost */
+        stats->lateness.observe(start - pair.second.next());
+        Metrics::get().missed(*stats, pair.second.advance(start));
         Subscription* sub = updateList->add_subscription();
         sub->CopyFrom(pair.first);
       }
     }
 
     if (updateList->subscription_size() > 0) {
+      /* Aggregated samples are reduced before they are written */
       status = BuildSubscribeNotification(response.mutable_update(),
-                                          updateRequest.subscribe());
-      if(!status.ok()) {
-        context->TryCancel();
-        return status;
+                                          updateRequest.subscribe(),
+                                          aggregator ? nullptr : stream);
+      if(!status.ok())
+        break;
+      if (aggregator != nullptr) {
+        aggregator->add(response.update());
+      } else if (!Write(stream, response)) {
+        GNXI_LOG(SUBSCRIBE, debug) << "Subscribe stream closed by client";
+        break;
       }
-      stream->Write(response);
       response.Clear();
+
+      /* Load of the tick, bursts show up as long ticks */
+      auto elapsed = steady_clock::now() - start;
+      Metrics::get().phase(Metrics::TICK).observe(elapsed);
+      GNXI_LOG(SUBSCRIBE, debug)
+        << "Tick sampled " << updateList->subscription_size()
+        << " subscriptions in "
+        << duration_cast<microseconds>(elapsed).count() << " us";
     }
 
-    // Caps the loop at 5 iterations per second
-    auto loopTime = high_resolution_clock::now() - start;
-    this_thread::sleep_for(milliseconds(200) - loopTime);
+    /* Aggregates are sent at the end of every window, windows do not drift
+     * with the duration of loop iterations */
+    if (aggregator != nullptr && start >= window_end) {
+      while (window_end <= start)
+        window_end += nanoseconds(aggregator->window());
+      if (!WriteAggregates(stream)) {
+        GNXI_LOG(SUBSCRIBE, debug) << "Subscribe stream closed by client";
+        break;
+      }
+    }
+
+    // Sleep until the next deadline, an absolute time so that the time
+    // spent sampling does not delay the next samples. Streams without
+    // SAMPLE subscription wake up every minute.
+    auto wakeup = start + minutes(1);
+    for (auto& pair : chronomap)
+      wakeup = min(wakeup, pair.second.next());
+    if (aggregator != nullptr)
+      wakeup = min(wakeup, window_end);
+    if (!events.wait_until(wakeup))
+      break;
   }
 
-  return Status::OK;
+  return status;
 }
 
 /**
  * Handles SubscribeRequest messages with ONCE subscription mode by updating
  * all the Subscriptions once, sending a SYNC message, then closing the RPC.
  */
-Status Subscribe::handleOnce(ServerContext* context, SubscribeRequest request,
-    ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream)
+Status Subscribe::handleOnce(
+    ServerContextBase* context, SubscribeRequest request,
+    SubscribeStream* stream)
 {
   Status status;
 
   // Sends a Notification message that updates all Subcriptions once
   SubscribeResponse response;
   status = BuildSubscribeNotification(response.mutable_update(),
-                                      request.subscribe());
+                                      request.subscribe(), stream);
   if (!status.ok()) {
     context->TryCancel();
     return status;
   }
 
-  stream->Write(response);
+  Write(stream, response);
   response.Clear();
 
   // Sends a message that indicates that initial synchronization
   // has completed, i.e. each Subscription has been updated once
   response.set_sync_response(true);
-  stream->Write(response);
+  Write(stream, response);
   response.Clear();
 
   return Status::OK;
@@ -293,10 +558,12 @@ Status Subscribe::handleOnce(ServerContext* context, SubscribeRequest request,
 
 /**
  * Handles SubscribeRequest messages with POLL subscription mode by updating
- * all the Subscriptions each time a Poll request is received.
+ * all the Subscriptions each time a Poll request is received, then sending a
+ * SYNC message.
  */
-Status Subscribe::handlePoll(ServerContext* context, SubscribeRequest request,
-    ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream)
+Status Subscribe::handlePoll(
+    ServerContextBase* context, SubscribeRequest request,
+    SubscribeStream* stream)
 {
   SubscribeRequest subscription = request;
   Status status;
@@ -308,13 +575,19 @@ Status Subscribe::handlePoll(ServerContext* context, SubscribeRequest request,
           // Sends a Notification message that updates all Subcriptions once
           SubscribeResponse response;
           status = BuildSubscribeNotification(response.mutable_update(),
-                                              subscription.subscribe());
+                                              subscription.subscribe(),
+                                              stream);
           if (!status.ok()) {
             context->TryCancel();
             return status;
           }
-          stream->Write(response);
+          Write(stream, response);
           response.Clear();
+
+          // Sends a SYNC message that ends the poll, the sample may have
+          // been split in several Notifications
+          response.set_sync_response(true);
+          Write(stream, response);
           break;
         }
       case request.kAliases:
@@ -331,22 +604,112 @@ Status Subscribe::handlePoll(ServerContext* context, SubscribeRequest request,
   return Status::OK;
 }
 
+/* Write one Notification per aggregation function of the window */
+bool Subscribe::WriteAggregates(
+    SubscribeStream* stream)
+{
+  for (auto &response : aggregator->flush(get_time_nanosec()))
+    if (!Write(stream, response))
+      return false;
+
+  return true;
+}
+
+/* Write a message, uncompressed if it is below compression threshold */
+bool Subscribe::Write(
+    SubscribeStream* stream,
+    const SubscribeResponse &response)
+{
+  LatencyTimer timer(Metrics::get().phase(Metrics::WRITE));
+  size_t size = response.ByteSizeLong();
+  bool ok;
+
+  if (compressed)
+    ok = stream->Write(response, compression.writeOptions(size));
+  else
+    ok = stream->Write(response);
+
+  if (!ok) {
+    Metrics::get().dropped(*stats, response.update().update_size());
+    return false;
+  }
+
+  stats->bytes.inc(size);
+  Metrics::get().sent(Metrics::SUBSCRIBE, size);
+
+  return true;
+}
+
+/**
+ * Handles gNMI depth extension and gnxi_server experimental extension, other
+ * extensions are not supported. See proto/gnxi_ext.proto.
+ */
+Status Subscribe::handleExtension(const gnmi_ext::Extension &extension,
+                                  const SubscribeRequest &request)
+{
+  gnxi_ext::Experimental experimental;
+
+  if (extension.has_depth()) {
+    read_options.depth = extension.depth().level();
+    return Status::OK;
+  }
+
+  if (!extension.has_registered_ext()
+      || extension.registered_ext().id() != gnmi_ext::EID_EXPERIMENTAL) {
+    GNXI_LOG(SUBSCRIBE, error) << "Extensions not implemented";
+    return Status(StatusCode::UNIMPLEMENTED, "Extensions not implemented");
+  }
+
+  if (!experimental.ParseFromString(extension.registered_ext().msg()))
+    return Status(StatusCode::INVALID_ARGUMENT,
+                  "Invalid experimental extension");
+
+  if (experimental.has_sampling()) {
+    if (request.subscribe().mode() != SubscriptionList_Mode_STREAM)
+      return Status(StatusCode::INVALID_ARGUMENT,
+                    "Sampling options require STREAM mode");
+    aligned = experimental.sampling().aligned();
+  }
+
+  if (experimental.has_aggregation()) {
+    if (request.subscribe().mode() != SubscriptionList_Mode_STREAM)
+      return Status(StatusCode::INVALID_ARGUMENT,
+                    "Aggregation requires STREAM mode");
+    /* Entries of lists are matched across samples by their keys */
+    shared_ptr<Encode> encode = encodef;
+    try {
+      aggregator = make_shared<Aggregator>(experimental.aggregation(),
+        [encode](const string &schema) { return encode->listKeys(schema); });
+    } catch (invalid_argument &exc) {
+      return Status(StatusCode::INVALID_ARGUMENT, exc.what());
+    }
+    GNXI_LOG(SUBSCRIBE, info) << "Aggregate samples over "
+                              << aggregator->window() << " ns windows";
+  }
+
+  if (experimental.has_pagination()) {
+    read_options.offset = experimental.pagination().offset();
+    read_options.limit = experimental.pagination().limit();
+  }
+
+  return Status::OK;
+}
+
 /**
  * Handles the first SubscribeRequest message.
  * If it does not have the "subscribe" field set, the RPC MUST be cancelled.
  * Ref: 3.5.1.1
  */
-Status Subscribe::run(ServerContext* context,
-                 ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream)
+Status Subscribe::run(ServerContextBase* context,
+    SubscribeStream* stream)
 {
   SubscribeRequest request;
+  Status status;
 
   stream->Read(&request);
 
-  if (request.extension_size() > 0) {
-    BOOST_LOG_TRIVIAL(error) << "Extensions not implemented";
-    return Status(StatusCode::UNIMPLEMENTED, "Extensions not implemented");
-  }
+  /* Must be set before first message is sent */
+  compressed = compression.apply(context, Compression::SUBSCRIBE);
 
   if (!request.has_subscribe()) {
     context->TryCancel();
@@ -354,19 +717,49 @@ Status Subscribe::run(ServerContext* context,
                   "SubscribeRequest needs non-empty SubscriptionList");
   }
 
+  for (auto &extension : request.extension()) {
+    status = handleExtension(extension, request);
+    if (!status.ok())
+      return status;
+  }
+
+  /* List the subscription in server statistics while it is running */
+  const Path *prefix = request.subscribe().has_prefix()
+                       ? &request.subscribe().prefix() : nullptr;
+  for (auto &sub : request.subscribe().subscription()) {
+    try {
+      stats->paths.push_back(*compiler->compile(sub.path(), prefix));
+    } catch (invalid_argument &exc) {
+      stats->paths.push_back(""); //rejected when sampled
+    }
+  }
+  stats->peer = context->peer();
+  stats->user = user;
+
   switch (request.subscribe().mode()) {
     case SubscriptionList_Mode_STREAM:
-      return handleStream(context, request, stream);
+      stats->mode = "stream";
+      Metrics::get().subscribe(stats);
+      status = handleStream(context, request, stream);
+      break;
     case SubscriptionList_Mode_ONCE:
-      return handleOnce(context, request, stream);
+      stats->mode = "once";
+      Metrics::get().subscribe(stats);
+      status = handleOnce(context, request, stream);
+      break;
     case SubscriptionList_Mode_POLL:
-      return handlePoll(context, request, stream);
+      stats->mode = "poll";
+      Metrics::get().subscribe(stats);
+      status = handlePoll(context, request, stream);
+      break;
     default:
-      BOOST_LOG_TRIVIAL(error) << "Unknown subscription mode";
+      GNXI_LOG(SUBSCRIBE, error) << "Unknown subscription mode";
       return Status(StatusCode::UNKNOWN, "Unknown subscription mode");
   }
 
-  return Status::OK;
+  Metrics::get().unsubscribe(stats->id);
+
+  return status;
 }
 
 }
@@ -17,45 +17,158 @@
 #ifndef _GNMI_SUBSCRIBE_H
 #define _GNMI_SUBSCRIBE_H
 
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
 #include <proto/gnmi.grpc.pb.h>
 
-#include <sysrepo-cpp/Session.hpp>
+#include <datastore/datastore.h>
 #include "encode/encode.h"
+#include "aggregate.h"
+#include <utils/xpath.h>
+#include <utils/metrics.h>
+#include "compression.h"
+#include <security/authorization.h>
 
 using namespace gnmi;
 using google::protobuf::RepeatedPtrField;
-using grpc::ServerReaderWriter;
-using grpc::ServerContext;
+using grpc::ServerContextBase;
 using grpc::Status;
 using grpc::StatusCode;
 
+/* Stream of a Subscribe RPC, whatever the gRPC API serving it */
+typedef grpc::ServerReaderWriterInterface<SubscribeResponse, SubscribeRequest>
+        SubscribeStream;
+
+/* Default lowest sample_interval of STREAM subscriptions */
+#define MIN_SAMPLE_INTERVAL std::chrono::milliseconds(50)
+
+/* Default size of the Notifications a large sample is split into */
+#define NOTIFICATION_CHUNK_SIZE (1 << 20)
+
 namespace impl {
 
+/* Wake up the sampling loop of a STREAM subscription as soon as the RPC
+ * terminates, rather than at the end of its current sleep. */
+class StreamEvents {
+  public:
+    StreamEvents() : done(false) {}
+
+    /* Wait until deadline, return false if the stream is terminated */
+    bool wait_until(std::chrono::steady_clock::time_point deadline)
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      return !cv.wait_until(lock, deadline, [this]{ return done; });
+    }
+
+    void terminate()
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      done = true;
+      cv.notify_all();
+    }
+
+    bool terminated()
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      return done;
+    }
+
+  private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done;
+};
+
 class Subscribe {
   public:
-    Subscribe(sysrepo::S_Session sess, std::shared_ptr<Encode> encode)
-      : sr_sess(sess), encodef(encode) {}
+    Subscribe(std::shared_ptr<Datastore> store, std::shared_ptr<Encode> encode,
+              std::shared_ptr<PathCompiler> comp, const Compression &compr,
+              std::shared_ptr<Authorizer> authorizer = nullptr,
+              const std::string &username = "")
+      : datastore(store), encodef(encode), compiler(comp), compression(compr),
+        compressed(false), authz(authorizer), user(username),
+        stats(std::make_shared<SubscriptionStats>()), aligned(false),
+        min_interval(MIN_SAMPLE_INTERVAL),
+        chunk_size(NOTIFICATION_CHUNK_SIZE), chunk_bytes(0) {}
     ~Subscribe() {}
 
-    Status run(ServerContext* context,
-               ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream);
+    Status run(ServerContextBase* context,
+               SubscribeStream* stream);
 
-  private:
-    Status BuildSubsUpdate(RepeatedPtrField<Update>* updateList,
-                           const Path &path, string fullpath,
-                           gnmi::Encoding encoding);
+    /* Terminate a running STREAM subscription, called by gRPC when the RPC
+     * is cancelled. Blocked reads and writes of stream return false. */
+    void cancel();
+
+    /* Lower sample intervals are rejected, 0 is sampled at this interval */
+    void setMinInterval(std::chrono::nanoseconds interval)
+    {
+      min_interval = interval;
+    }
+
+    /* Samples are split in Notifications of about size bytes, 0 to never
+     * split them */
+    void setChunkSize(size_t size) { chunk_size = size; }
+
+    /* Build the Notification of one sample of request */
     Status BuildSubscribeNotification(Notification *notification,
-                                      const SubscriptionList& request);
-    Status handleStream(ServerContext* context, SubscribeRequest request,
-              ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream);
-    Status handleOnce(ServerContext* context, SubscribeRequest request,
-              ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream);
-    Status handlePoll(ServerContext* context, SubscribeRequest request,
-              ServerReaderWriter<SubscribeResponse, SubscribeRequest>* stream);
+        const SubscriptionList& request,
+        SubscribeStream* stream
+          = nullptr);
+
+  private:
+    Status handleExtension(const gnmi_ext::Extension &extension,
+                           const SubscribeRequest &request);
+    bool AddUpdate(Notification *notification, const Path *prefix,
+        const Path &path, JsonData &it,
+        SubscribeStream* stream);
+    bool AddChunk(Notification *notification, size_t bytes,
+        SubscribeStream* stream);
+    bool WriteChunk(Notification *notification,
+        SubscribeStream* stream);
+    Status BuildSubsUpdate(Notification *notification,
+        const Path *prefix, const Path &path,
+        const string &fullpath, gnmi::Encoding encoding,
+        SubscribeStream* stream);
+    Status BuildSubsPath(Notification *notification,
+        const Path *prefix, const Path &path, gnmi::Encoding encoding,
+        SubscribeStream* stream);
+    Status handleStream(ServerContextBase* context, SubscribeRequest request,
+              SubscribeStream* stream);
+    Status handleOnce(ServerContextBase* context, SubscribeRequest request,
+              SubscribeStream* stream);
+    Status handlePoll(ServerContextBase* context, SubscribeRequest request,
+              SubscribeStream* stream);
+    bool Write(SubscribeStream* stream,
+               const SubscribeResponse &response);
+    bool WriteAggregates(
+        SubscribeStream* stream);
+
+    /* Subscription path covered by the path being sampled */
+    struct CoveredPath {
+      const Path *path;
+      bool resolved; //false if path must be read
+      std::vector<Update> updates; //extracted from the other path
+    };
 
   private:
-    sysrepo::S_Session sr_sess; //sysrepo session
+    std::shared_ptr<Datastore> datastore; //data read and modified
     std::shared_ptr<Encode> encodef; //support for json ietf encoding
+    std::shared_ptr<PathCompiler> compiler; //gNMI path to xpath conversion
+    const Compression &compression; //compression policy
+    bool compressed; //compression is enabled for this call
+    std::shared_ptr<Authorizer> authz; //access rules, nullptr if none
+    std::string user; //identity of client
+    std::shared_ptr<SubscriptionStats> stats; //statistics of this RPC
+    std::shared_ptr<Aggregator> aggregator; //downsampling, nullptr if none
+    bool aligned; //sample on wall-clock multiples of intervals
+    std::chrono::nanoseconds min_interval; //lowest sample interval
+    ReadOptions read_options; //depth and pagination of samples
+    size_t chunk_size; //bytes of updates written in one Notification
+    size_t chunk_bytes; //bytes of updates of the current chunk
+    std::vector<CoveredPath> covering; //served by the path being sampled
+    StreamEvents events; //cancellation of the STREAM sampling loop
 };
 
 }
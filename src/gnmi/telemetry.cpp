@@ -0,0 +1,213 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include <utils/log.h>
+#include <utils/metrics.h>
+#include <utils/utils.h>
+
+#include "telemetry.h"
+
+using namespace std;
+
+/* 64 bits integers are JSON strings in JSON IETF (RFC 7951) */
+static Json::Value json_uint64(uint64_t val)
+{
+  return Json::Value(to_string(val));
+}
+
+static Json::Value json_latency(const Histogram &hist)
+{
+  Json::Value val;
+
+  val["count"] = json_uint64(hist.count());
+  val["total-us"] = json_uint64(static_cast<uint64_t>(hist.sum() * 1e6));
+
+  return val;
+}
+
+/* Key of statistics lists, nullptr if name is not a list */
+static const char* list_key(const string &name)
+{
+  static const map<string, const char*> keys = {
+    {"rpc", "name"}, {"response", "code"}, {"phase", "name"},
+    {"subscription", "id"}, {"cache", "name"}
+  };
+
+  auto it = keys.find(name);
+  return it == keys.end() ? nullptr : it->second;
+}
+
+/* Snapshot of every statistic, under its root node */
+static Json::Value statistics()
+{
+  Metrics &metrics = Metrics::get();
+  Json::Value root, &stats = root["statistics"];
+
+  stats["rpcs"] = Json::objectValue;
+  for (int i = 0; i < Metrics::RPC_MAX; i++) {
+    Metrics::Rpc rpc = Metrics::Rpc(i);
+    Json::Value val;
+
+    val["name"] = Metrics::rpcName(rpc);
+    val["requests"] = json_uint64(metrics.requestCount(rpc).value());
+    val["bytes-sent"] = json_uint64(metrics.sentBytes(rpc).value());
+    val["latency"] = json_latency(metrics.duration(rpc));
+    val["responses"] = Json::objectValue;
+    for (int code = 0; code < Metrics::CODE_MAX; code++) {
+      uint64_t count = metrics.responseCount(rpc, code).value();
+      if (count == 0)
+        continue;
+      Json::Value response;
+      response["code"] = Metrics::codeName(code);
+      response["count"] = json_uint64(count);
+      val["responses"]["response"].append(response);
+    }
+    stats["rpcs"]["rpc"].append(val);
+  }
+
+  stats["phases"] = Json::objectValue;
+  for (int i = 0; i < Metrics::PHASE_MAX; i++) {
+    Metrics::Phase phase = Metrics::Phase(i);
+    Json::Value val = json_latency(metrics.phase(phase));
+
+    val["name"] = Metrics::phaseName(phase);
+    stats["phases"]["phase"].append(val);
+  }
+
+  stats["subscriptions"] = Json::objectValue;
+  for (auto &sub : metrics.subscriptions()) {
+    Json::Value val;
+
+    val["id"] = to_string(sub->id);
+    val["peer"] = sub->peer;
+    val["user"] = sub->user;
+    val["mode"] = sub->mode;
+    for (auto &path : sub->paths)
+      val["path"].append(path);
+    for (auto interval : sub->intervals)
+      val["sample-interval"].append(json_uint64(interval));
+    val["samples"] = json_uint64(sub->samples.value());
+    val["bytes-sent"] = json_uint64(sub->bytes.value());
+    val["dropped-updates"] = json_uint64(sub->dropped.value());
+    val["missed-samples"] = json_uint64(sub->missed.value());
+    val["latency"] = json_latency(sub->latency);
+    val["lateness"] = json_latency(sub->lateness);
+    stats["subscriptions"]["subscription"].append(val);
+  }
+
+  stats["caches"] = Json::objectValue;
+  for (int i = 0; i < Metrics::CACHE_MAX; i++) {
+    Metrics::Cache cache = Metrics::Cache(i);
+    Json::Value val;
+
+    val["name"] = Metrics::cacheName(cache);
+    val["hits"] = json_uint64(metrics.cacheHits(cache).value());
+    val["misses"] = json_uint64(metrics.cacheMisses(cache).value());
+    stats["caches"]["cache"].append(val);
+  }
+
+  stats["active-streams"] = to_string(metrics.streams().value());
+  stats["log"]["dropped"] = json_uint64(Log::dropped());
+
+  return root;
+}
+
+/* Node names are compared without module name */
+static string local_name(const string &name)
+{
+  size_t colon = name.find(':');
+
+  return colon == string::npos ? name : name.substr(colon + 1);
+}
+
+/* Collect nodes matching path from depth, xpath is the one of node */
+static void walk(const Json::Value &node, const gnmi::Path &path, int depth,
+                 const string &xpath, vector<JsonData> *out)
+{
+  if (depth == path.elem_size()) {
+    Json::FastWriter writer;
+    JsonData data;
+    data.xpath = xpath;
+    data.data = writer.write(node);
+    out->push_back(data);
+    return;
+  }
+
+  if (!node.isObject())
+    return;
+
+  const gnmi::PathElem &elem = path.elem(depth);
+  string name = local_name(elem.name());
+  vector<string> children;
+
+  if (name == "*")
+    children = node.getMemberNames();
+  else if (node.isMember(name))
+    children.push_back(name);
+
+  for (auto &child : children) {
+    const Json::Value &val = node[child];
+    const char *key = list_key(child);
+    string step = xpath + "/" + (depth == 0 ? TELEMETRY_ORIGIN ":" : "")
+                  + child;
+
+    if (!val.isArray() || key == nullptr) {
+      if (elem.key_size() == 0)
+        walk(val, path, depth + 1, step, out);
+      continue;
+    }
+
+    /* List entries matching every key of the path element */
+    for (auto &entry : val) {
+      bool match = true;
+      for (auto &k : elem.key()) {
+        if (k.second != "*" && entry.get(k.first, "").asString() != k.second)
+          match = false;
+      }
+      if (match)
+        walk(entry, path, depth + 1,
+             step + "[" + key + "=" + xpath_quote(entry[key].asString()) + "]",
+             out);
+    }
+  }
+}
+
+bool Telemetry::match(const string &xpath)
+{
+  static const char *root = "/" TELEMETRY_ORIGIN ":";
+
+  return xpath.compare(0, strlen(root), root) == 0;
+}
+
+vector<JsonData> Telemetry::json_read(const string &xpath,
+                                      PathCompiler &compiler)
+{
+  vector<JsonData> json_vec;
+  gnmi::Path path;
+
+  GNXI_LOG(SERVER, debug) << "read statistics for " << xpath;
+
+  compiler.parse(xpath, &path);
+  walk(statistics(), path, 0, "", &json_vec);
+  if (json_vec.empty())
+    throw invalid_argument("xpath not found");
+
+  return json_vec;
+}
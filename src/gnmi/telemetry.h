@@ -0,0 +1,58 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNMI_TELEMETRY_H
+#define _GNMI_TELEMETRY_H
+
+#include <string>
+#include <vector>
+
+#include "encode/encode.h"
+#include <utils/xpath.h>
+
+/* Origin, or module name, of server statistics paths */
+#define TELEMETRY_ORIGIN "gnxi"
+
+/*
+ * Telemetry - Statistics of gnxi_server read like device data, with Get and
+ * Subscribe, under the "gnxi" origin:
+ *
+ * /gnxi:statistics
+ *   rpcs/rpc[name]: requests, bytes-sent, latency, responses/response[code]
+ *   phases/phase[name]: latency of sysrepo reads, encoding, writes...
+ *   subscriptions/subscription[id]: peer, user, mode, path, sample-interval,
+ *                                   samples, bytes-sent, dropped-updates,
+ *                                   missed-samples, latency, lateness
+ *   caches/cache[name]: hits, misses
+ *   active-streams, log/dropped
+ *
+ * Latencies are a count and a total in microseconds. Values are encoded in
+ * JSON IETF, 64 bits integers are strings. Names and keys can be wildcards.
+ */
+class Telemetry {
+  public:
+    /* Return true if xpath addresses server statistics */
+    static bool match(const std::string &xpath);
+
+    /*
+     * Read statistics nodes matching xpath, like Encode::json_read.
+     * @throw invalid_argument if no node matches
+     */
+    static std::vector<JsonData> json_read(const std::string &xpath,
+                                           PathCompiler &compiler);
+};
+
+#endif //_GNMI_TELEMETRY_H
@@ -18,32 +18,205 @@
 #include <memory>
 #include <chrono>
 #include <getopt.h>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <grp.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <grpcpp/grpcpp.h>
 #include <grpcpp/server.h>
 #include <grpcpp/server_builder.h>
+#include <grpcpp/resource_quota.h>
 
 #include "gnmi/gnmi.h"
+#include <datastore/datastore.h>
 #include <security/authentication.h>
 #include <utils/log.h>
+#include <utils/http.h>
+#include <utils/metrics.h>
 
 using namespace std;
 
-void RunServer(string bind_addr, shared_ptr<ServerCredentials> cred)
+/* Server performance settings, 0 keeps gRPC or gnxi_server default value */
+struct ServerTuning {
+  int min_pollers = 0;          //minimum number of polling threads
+  int max_pollers = 0;          //maximum number of polling threads
+  int max_threads = 0;          //maximum number of threads in resource quota
+  size_t memory_quota = 0;      //maximum memory of resource quota in bytes
+  int max_streams = 0;          //maximum concurrent streams per connection
+  int max_recv_msg_size = 0;    //maximum received message size in bytes
+  int max_send_msg_size = 0;    //maximum sent message size in bytes
+  int keepalive_time = 0;       //HTTP/2 keepalive ping period in ms
+  int keepalive_timeout = 0;    //HTTP/2 keepalive ping timeout in ms
+  int min_sample_interval = 0;  //lowest SAMPLE interval honoured in ms
+  size_t max_get_size = 0;      //GetResponse size budget in bytes
+  size_t chunk_size = 0;        //bytes of updates per Subscribe Notification
+};
+
+/* Apply performance settings to gRPC server */
+static void TuneServer(ServerBuilder &builder, const ServerTuning &tuning)
+{
+  if (tuning.min_pollers > 0)
+    builder.SetSyncServerOption(ServerBuilder::MIN_POLLERS, tuning.min_pollers);
+  if (tuning.max_pollers > 0)
+    builder.SetSyncServerOption(ServerBuilder::MAX_POLLERS, tuning.max_pollers);
+
+  if (tuning.max_threads > 0 || tuning.memory_quota > 0) {
+    ResourceQuota quota("gnxi_server");
+    if (tuning.max_threads > 0)
+      quota.SetMaxThreads(tuning.max_threads);
+    if (tuning.memory_quota > 0)
+      quota.Resize(tuning.memory_quota);
+    builder.SetResourceQuota(quota);
+  }
+
+  if (tuning.max_streams > 0)
+    builder.AddChannelArgument(GRPC_ARG_MAX_CONCURRENT_STREAMS,
+                               tuning.max_streams);
+  if (tuning.max_recv_msg_size > 0)
+    builder.SetMaxReceiveMessageSize(tuning.max_recv_msg_size);
+  if (tuning.max_send_msg_size > 0)
+    builder.SetMaxSendMessageSize(tuning.max_send_msg_size);
+
+  if (tuning.keepalive_time > 0) {
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIME_MS,
+                               tuning.keepalive_time);
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+    /* Clients are allowed to ping as often as we do */
+    builder.AddChannelArgument(
+        GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS,
+        tuning.keepalive_time);
+    builder.AddChannelArgument(GRPC_ARG_HTTP2_MAX_PINGS_WITHOUT_DATA, 0);
+  }
+  if (tuning.keepalive_timeout > 0)
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIMEOUT_MS,
+                               tuning.keepalive_timeout);
+}
+
+/*
+ * Additional listeners, besides the main bind address.
+ * unix: listeners are not encrypted nor authenticated by gRPC, access is
+ * controlled with the permissions of the socket file.
+ */
+struct Listeners {
+  vector<string> uris;        //additional listening URIs
+  mode_t unix_mode = 0660;    //permissions of unix domain sockets
+  string unix_group;          //group owning unix domain sockets
+};
+
+static bool is_unix(const string &uri)
+{
+  return uri.compare(0, 5, "unix:") == 0;
+}
+
+/* Socket file path of a unix:path or unix:///path URI */
+static string unix_path(const string &uri)
+{
+  string path = uri.substr(5);
+
+  if (path.compare(0, 2, "//") == 0)
+    path.erase(0, 2);
+
+  return path;
+}
+
+/* Remove socket file left by a previous instance */
+static void RemoveStaleSocket(const string &path)
+{
+  struct stat st;
+
+  if (lstat(path.c_str(), &st) != 0)
+    return;
+
+  if (!S_ISSOCK(st.st_mode)) {
+    cerr << path << " exists and is not a socket" << endl;
+    exit(1);
+  }
+
+  unlink(path.c_str());
+}
+
+/* Give unix domain socket its group and permissions */
+static void SetSocketPermissions(const string &path, const Listeners &listeners)
+{
+  if (!listeners.unix_group.empty()) {
+    struct group *grp = getgrnam(listeners.unix_group.c_str());
+    if (grp == nullptr) {
+      cerr << "Unknown group " << listeners.unix_group << endl;
+      exit(1);
+    }
+    if (chown(path.c_str(), -1, grp->gr_gid) != 0) {
+      cerr << "Failed to change group of " << path << endl;
+      exit(1);
+    }
+  }
+
+  if (chmod(path.c_str(), listeners.unix_mode) != 0) {
+    cerr << "Failed to change permissions of " << path << endl;
+    exit(1);
+  }
+}
+
+void RunServer(string bind_addr, shared_ptr<ServerCredentials> cred,
+               const ServerTuning &tuning, const Listeners &listeners,
+               const Compression &compression, shared_ptr<Authorizer> authz,
+               shared_ptr<Datastore> datastore)
 {
   ServerBuilder builder;
-  GNMIService gnmi("gnmi"); //gNMI Service
+  GNMIService gnmi(datastore, compression, authz); //gNMI Service
+  vector<string> uris(listeners.uris);
+  mode_t old_mask;
 
+  TuneServer(builder, tuning);
   builder.AddListeningPort(bind_addr, cred);
+  for (auto &uri : listeners.uris) {
+    if (is_unix(uri)) //co-located clients, filesystem permissions auth
+      builder.AddListeningPort(uri, grpc::InsecureServerCredentials());
+    else
+      builder.AddListeningPort(uri, cred);
+  }
+  if (tuning.min_sample_interval > 0)
+    gnmi.setMinSampleInterval(
+      chrono::milliseconds(tuning.min_sample_interval));
+  if (tuning.max_get_size > 0)
+    gnmi.setMaxGetSize(tuning.max_get_size);
+  if (tuning.chunk_size > 0)
+    gnmi.setChunkSize(tuning.chunk_size);
+  if (tuning.max_threads > 0)
+    gnmi.setMaxSubscriptions(tuning.max_threads);
   builder.RegisterService(&gnmi);
+
+  uris.push_back(bind_addr);
+  for (auto &uri : uris) {
+    if (is_unix(uri))
+      RemoveStaleSocket(unix_path(uri));
+  }
+
+  /* Sockets must not be reachable by others before permissions are set */
+  old_mask = umask(~listeners.unix_mode & 0777);
   unique_ptr<Server> server(builder.BuildAndStart());
+  umask(old_mask);
+  if (server == nullptr) {
+    cerr << "Failed to start server on " << bind_addr << endl;
+    exit(1);
+  }
   cout << "Using grpc " << grpc::Version() << endl;
 
+  for (auto &uri : uris) {
+    if (is_unix(uri))
+      SetSocketPermissions(unix_path(uri), listeners);
+  }
+
   if (bind_addr.find(":") == string::npos) {
     cout << "Server listening on " << bind_addr << ":443" << endl;
   } else {
     cout << "Server listening on " << bind_addr << endl;
   }
+  for (auto &uri : listeners.uris)
+    cout << "Server listening on " << uri << endl;
 
   server->Wait();
 }
@@ -55,23 +228,141 @@ static void show_usage(string name)
     << "\t-h,--help\t\t\tShow this help message\n"
     << "\t-u,--username USERNAME\t\tDefine connection username\n"
     << "\t-p,--password PASSWORD\t\tDefine connection password\n"
+    << "\t--credentials FILE\t\tUsers allowed to connect, username:hash lines\n"
+    << "\t--hash-password\t\t\tPrint hash of password read on stdin and exit\n"
+    << "\t--authz FILE\t\t\tPer-user access rules, USER r|w|rw XPATH lines\n"
     << "\t-f,--force-insecure\t\tNo TLS connection, no password authentication\n"
     << "\t-k,--private-key PRIVATE_KEY\tpath to server TLS private key\n"
     << "\t-c,--cert CERTIFICATE\tpath to server TLS certificate\n"
     << "\t-r,--ca CERTIFICATE\tpath to root certificate/CA certificate\n"
-    << "\t-l,--log-level LOG_LEVEL\tLog level\n"
+    << "\t--cert-refresh SECONDS\t\tReload changed TLS files (60), 0 = never\n"
+    << "\t-l,--log-level [COMPONENT=]LOG_LEVEL\tLog level, can be repeated\n"
     << "\t\t 0 = all logging turned off\n"
     << "\t\t 1 = log only error messages\n"
     << "\t\t 2 = (default) log error and warning messages\n"
     << "\t\t 3 = log error, warning and informational messages\n"
     << "\t\t 4 = log everything, including development debug messages\n"
+    << "\t\t COMPONENT = server, get, set, subscribe, encode, security\n"
     << "\t-b,--bind URI\t\t\tBind to an URI\n"
     << "\t\t URI = PREFIX://IP:PORT\n"
     << "\t\t URI = IP:PORT, default to dns:// prefix\n"
     << "\t\t URI = IP, default to dns:// prefix and port 443\n"
+    << "\t--listen URI\t\t\tAdditional listener, can be repeated\n"
+    << "\t\t URI = unix:PATH, no TLS, no password authentication\n"
+    << "\t--unix-mode MODE\t\tPermissions of unix sockets (0660)\n"
+    << "\t--unix-group GROUP\t\tGroup owning unix sockets\n"
+    << "\t--compression ALGO\t\tCompress responses of all RPCs\n"
+    << "\t\t ALGO = none (default), deflate, gzip\n"
+    << "\t--compression-rpc RPC=ALGO\tCompress responses of one RPC\n"
+    << "\t\t RPC = capabilities, get, set, subscribe\n"
+    << "\t--compression-threshold BYTES\tDo not compress smaller messages\n"
+    << "\t--datastore URI\t\t\tDatastore read and modified by RPCs\n"
+    << "\t\t URI = sysrepo (default)\n"
+    << "\t\t URI = memory:DIR, YANG modules and JSON data of DIR\n"
+    << "\t--http HOST:PORT\t\tAdministration HTTP endpoint, serves /metrics\n"
+    << "\t\t and /loglevel\n"
+    << "\t--min-sample-interval MS\tLowest sample_interval of STREAM\n"
+    << "\t\t subscriptions (50), lower ones are rejected\n"
+    << "\t--max-get-size BYTES\t\tLargest GetResponse, larger ones fail\n"
+    << "\t\t with RESOURCE_EXHAUSTED (unlimited)\n"
+    << "\t--chunk-size BYTES\t\tSplit Subscribe samples in Notifications\n"
+    << "\t\t of about BYTES (1048576)\n"
+    << "Performance options (default to gRPC values):\n"
+    << "\t--min-pollers N\t\t\tMinimum number of polling threads\n"
+    << "\t--max-pollers N\t\t\tMaximum number of polling threads\n"
+    << "\t--max-threads N\t\t\tMaximum number of server threads\n"
+    << "\t--memory-quota BYTES\t\tMaximum memory used by gRPC\n"
+    << "\t--max-streams N\t\t\tMaximum concurrent streams per client\n"
+    << "\t--max-recv-msg-size BYTES\tMaximum received message size\n"
+    << "\t--max-send-msg-size BYTES\tMaximum sent message size\n"
+    << "\t--keepalive-time MS\t\tHTTP/2 keepalive ping period\n"
+    << "\t--keepalive-timeout MS\t\tHTTP/2 keepalive ping timeout\n"
     << endl;
 }
 
+/* Long options without short option character */
+enum {
+  OPT_MIN_POLLERS = 256,
+  OPT_MAX_POLLERS,
+  OPT_MAX_THREADS,
+  OPT_MEMORY_QUOTA,
+  OPT_MAX_STREAMS,
+  OPT_MAX_RECV_MSG_SIZE,
+  OPT_MAX_SEND_MSG_SIZE,
+  OPT_KEEPALIVE_TIME,
+  OPT_KEEPALIVE_TIMEOUT,
+  OPT_LISTEN,
+  OPT_UNIX_MODE,
+  OPT_UNIX_GROUP,
+  OPT_COMPRESSION,
+  OPT_COMPRESSION_RPC,
+  OPT_COMPRESSION_THRESHOLD,
+  OPT_CREDENTIALS,
+  OPT_HASH_PASSWORD,
+  OPT_CERT_REFRESH,
+  OPT_AUTHZ,
+  OPT_HTTP,
+  OPT_DATASTORE,
+  OPT_MIN_SAMPLE_INTERVAL,
+  OPT_MAX_GET_SIZE,
+  OPT_CHUNK_SIZE,
+};
+
+/* Parse a positive number given to option name, exit if it is invalid */
+static unsigned long long parse_number(const char *name, const char *arg,
+                                       unsigned long long max, int base = 10)
+{
+  char *end = nullptr;
+  unsigned long long val;
+
+  errno = 0;
+  val = strtoull(arg, &end, base);
+  if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-'
+      || val > max) {
+    cerr << "Invalid value " << arg << " for --" << name << endl;
+    exit(1);
+  }
+
+  return val;
+}
+
+/*
+ * GET /loglevel shows log levels of components,
+ * PUT /loglevel?COMPONENT=LEVEL sets them, COMPONENT can be "all".
+ * The endpoint is not authenticated, levels are only set by loopback clients.
+ */
+static void log_level_handler(const HttpRequest &req, HttpResponse *resp)
+{
+  if (req.method == "PUT" || req.method == "POST") {
+    if (!req.loopback) {
+      resp->status = 403;
+      resp->body = "Log levels can only be set from loopback\n";
+      return;
+    }
+
+    for (auto &param : req.query) {
+      char *end = nullptr;
+      long lvl = strtol(param.second.c_str(), &end, 10);
+      if (param.second.empty() || *end != '\0'
+          || !Log::setLevel(param.first, lvl)) {
+        resp->status = 400;
+        resp->body = "Invalid log level " + param.first + "=" + param.second
+                     + "\n";
+        return;
+      }
+      GNXI_LOG(SERVER, info) << "Log level of " << param.first << " set to "
+                             << lvl;
+    }
+  } else if (req.method != "GET") {
+    resp->status = 405;
+    return;
+  }
+
+  for (int i = 0; i < Log::COMPONENT_MAX; i++)
+    resp->body += string(Log::componentName(Log::Component(i))) + " "
+                  + to_string(Log::level(Log::Component(i))) + "\n";
+}
+
 int main (int argc, char* argv[]) {
   int c;
   extern char *optarg;
@@ -80,6 +371,19 @@ int main (int argc, char* argv[]) {
   string username, password;
   Log();
   AuthBuilder auth;
+  ServerTuning tuning;
+  Listeners listeners;
+  Compression compression;
+  shared_ptr<Authorizer> authz;
+  string http_addr;
+  shared_ptr<HttpServer> http;
+  string datastore_uri = "sysrepo";
+  shared_ptr<Datastore> datastore;
+  grpc_compression_algorithm algo;
+  Compression::Rpc rpc;
+  string rpc_algo;
+  string log_level;
+  size_t sep;
 
   static struct option long_options[] =
   {
@@ -87,11 +391,35 @@ int main (int argc, char* argv[]) {
     {"log-level", required_argument, 0, 'l'}, //log level
     {"username", required_argument, 0, 'u'},
     {"password", required_argument, 0, 'p'},
+    {"credentials", required_argument, 0, OPT_CREDENTIALS},
+    {"hash-password", no_argument, 0, OPT_HASH_PASSWORD},
+    {"authz", required_argument, 0, OPT_AUTHZ},
+    {"http", required_argument, 0, OPT_HTTP},
+    {"datastore", required_argument, 0, OPT_DATASTORE},
+    {"min-sample-interval", required_argument, 0, OPT_MIN_SAMPLE_INTERVAL},
+    {"max-get-size", required_argument, 0, OPT_MAX_GET_SIZE},
+    {"chunk-size", required_argument, 0, OPT_CHUNK_SIZE},
     {"private-key", required_argument, 0, 'k'}, //private key
     {"cert", required_argument, 0, 'c'}, //certificate chain
     {"ca", required_argument, 0, 'r'}, //certificate chain
+    {"cert-refresh", required_argument, 0, OPT_CERT_REFRESH},
     {"force-insecure", no_argument, 0, 'f'}, //insecure mode
     {"bind", required_argument, 0, 'b'}, //insecure mode
+    {"min-pollers", required_argument, 0, OPT_MIN_POLLERS},
+    {"max-pollers", required_argument, 0, OPT_MAX_POLLERS},
+    {"max-threads", required_argument, 0, OPT_MAX_THREADS},
+    {"memory-quota", required_argument, 0, OPT_MEMORY_QUOTA},
+    {"max-streams", required_argument, 0, OPT_MAX_STREAMS},
+    {"max-recv-msg-size", required_argument, 0, OPT_MAX_RECV_MSG_SIZE},
+    {"max-send-msg-size", required_argument, 0, OPT_MAX_SEND_MSG_SIZE},
+    {"keepalive-time", required_argument, 0, OPT_KEEPALIVE_TIME},
+    {"keepalive-timeout", required_argument, 0, OPT_KEEPALIVE_TIMEOUT},
+    {"listen", required_argument, 0, OPT_LISTEN},
+    {"unix-mode", required_argument, 0, OPT_UNIX_MODE},
+    {"unix-group", required_argument, 0, OPT_UNIX_GROUP},
+    {"compression", required_argument, 0, OPT_COMPRESSION},
+    {"compression-rpc", required_argument, 0, OPT_COMPRESSION_RPC},
+    {"compression-threshold", required_argument, 0, OPT_COMPRESSION_THRESHOLD},
     {0, 0, 0, 0}
   };
 
@@ -116,6 +444,29 @@ int main (int argc, char* argv[]) {
       case 'p': //password
         auth.setPassword(string(optarg));
         break;
+      case OPT_CREDENTIALS: //file of hashed credentials
+        auth.setCredentialsPath(string(optarg));
+        break;
+      case OPT_HASH_PASSWORD: //generate a credentials file entry
+        getline(cin, password);
+        cout << CredentialStore::hash(password) << endl;
+        exit(0);
+        break;
+      case OPT_AUTHZ: //access rules
+        authz = make_shared<Authorizer>();
+        try {
+          authz->load(optarg);
+        } catch (runtime_error &exc) {
+          cerr << exc.what() << endl;
+          exit(1);
+        }
+        break;
+      case OPT_HTTP: //administration endpoint
+        http_addr = optarg;
+        break;
+      case OPT_DATASTORE: //backend of RPCs
+        datastore_uri = optarg;
+        break;
       case 'k': //server private key
         auth.setKeyPath(string(optarg));
         break;
@@ -125,8 +476,21 @@ int main (int argc, char* argv[]) {
       case 'r': //CA/root certificate
         auth.setRootCertPath(string(optarg));
         break;
-      case 'l': //log level
-        Log::setLevel(atoi(optarg));
+      case OPT_CERT_REFRESH: //period of TLS files reload
+        auth.setCertRefresh(parse_number("cert-refresh", optarg, UINT_MAX));
+        break;
+      case 'l': //log level, of every component or of one
+        log_level = optarg;
+        sep = log_level.find('=');
+        if (sep == string::npos) {
+          Log::setLevel(atoi(optarg));
+        } else if (!Log::setLevel(log_level.substr(0, sep),
+                                  parse_number("log-level", optarg + sep + 1,
+                                               4))) {
+          cerr << "Unknown log component " << log_level.substr(0, sep)
+               << endl;
+          exit(1);
+        }
         break;
       case 'b': //binding address
         bind_addr = optarg;
@@ -134,12 +498,116 @@ int main (int argc, char* argv[]) {
       case 'f': //force insecure connection
         auth.setInsecure(true);
         break;
+      case OPT_MIN_POLLERS:
+        tuning.min_pollers = parse_number("min-pollers", optarg, INT_MAX);
+        break;
+      case OPT_MAX_POLLERS:
+        tuning.max_pollers = parse_number("max-pollers", optarg, INT_MAX);
+        break;
+      case OPT_MAX_THREADS:
+        tuning.max_threads = parse_number("max-threads", optarg, INT_MAX);
+        break;
+      case OPT_MEMORY_QUOTA:
+        tuning.memory_quota = parse_number("memory-quota", optarg, SIZE_MAX);
+        break;
+      case OPT_MAX_STREAMS:
+        tuning.max_streams = parse_number("max-streams", optarg, INT_MAX);
+        break;
+      case OPT_MAX_RECV_MSG_SIZE:
+        tuning.max_recv_msg_size = parse_number("max-recv-msg-size", optarg,
+                                                INT_MAX);
+        break;
+      case OPT_MAX_SEND_MSG_SIZE:
+        tuning.max_send_msg_size = parse_number("max-send-msg-size", optarg,
+                                                INT_MAX);
+        break;
+      case OPT_KEEPALIVE_TIME:
+        tuning.keepalive_time = parse_number("keepalive-time", optarg,
+                                             INT_MAX);
+        break;
+      case OPT_KEEPALIVE_TIMEOUT:
+        tuning.keepalive_timeout = parse_number("keepalive-timeout", optarg,
+                                                INT_MAX);
+        break;
+      case OPT_MIN_SAMPLE_INTERVAL:
+        tuning.min_sample_interval = parse_number("min-sample-interval",
+                                                  optarg, INT_MAX);
+        break;
+      case OPT_MAX_GET_SIZE:
+        tuning.max_get_size = parse_number("max-get-size", optarg, SIZE_MAX);
+        break;
+      case OPT_CHUNK_SIZE:
+        tuning.chunk_size = parse_number("chunk-size", optarg, SIZE_MAX);
+        break;
+      case OPT_LISTEN: //additional listener
+        listeners.uris.push_back(optarg);
+        break;
+      case OPT_UNIX_MODE: //octal permissions of unix sockets
+        listeners.unix_mode = parse_number("unix-mode", optarg, 0777, 8);
+        break;
+      case OPT_UNIX_GROUP:
+        listeners.unix_group = optarg;
+        break;
+      case OPT_COMPRESSION: //default algorithm for all RPCs
+        if (!Compression::parseAlgorithm(optarg, &algo)) {
+          cerr << "Unknown compression algorithm " << optarg << endl;
+          exit(1);
+        }
+        compression.setDefault(algo);
+        break;
+      case OPT_COMPRESSION_RPC: //RPC=ALGO
+        rpc_algo = optarg;
+        sep = rpc_algo.find('=');
+        if (sep == string::npos
+            || !Compression::parseRpc(rpc_algo.substr(0, sep), &rpc)
+            || !Compression::parseAlgorithm(rpc_algo.substr(sep + 1), &algo)) {
+          cerr << "Invalid value " << optarg << " for --compression-rpc"
+               << endl;
+          exit(1);
+        }
+        compression.setRpc(rpc, algo);
+        break;
+      case OPT_COMPRESSION_THRESHOLD:
+        compression.setThreshold(parse_number("compression-threshold", optarg,
+                                              SIZE_MAX));
+        break;
       default: /* You won't get there */
         exit(1);
     }
   }
 
-  RunServer(bind_addr, auth.build());
+  if (tuning.min_pollers > 0 && tuning.max_pollers > 0
+      && tuning.min_pollers > tuning.max_pollers) {
+    cerr << "--min-pollers can not be greater than --max-pollers" << endl;
+    exit(1);
+  }
+
+  /* Prometheus scraping and runtime log levels endpoint */
+  if (!http_addr.empty()) {
+    http = make_shared<HttpServer>(http_addr);
+    http->handle("/metrics", [](const HttpRequest &req, HttpResponse *resp) {
+      (void)req;
+      resp->content_type = "text/plain; version=0.0.4; charset=utf-8";
+      resp->body = Metrics::get().prometheus();
+    });
+    http->handle("/loglevel", log_level_handler);
+    try {
+      http->start();
+    } catch (runtime_error &exc) {
+      cerr << exc.what() << endl;
+      exit(1);
+    }
+  }
+
+  try {
+    datastore = Datastore::open(datastore_uri);
+  } catch (runtime_error &exc) {
+    cerr << "Connection to datastore failed " << exc.what() << endl;
+    exit(1);
+  }
+
+  RunServer(bind_addr, auth.build(), tuning, listeners, compression, authz,
+            datastore);
 
   return 0;
 }
@@ -16,6 +16,11 @@
 
 #include <fstream>
 
+#ifdef HAVE_TLS_CERTIFICATE_PROVIDER
+#include <grpcpp/security/tls_certificate_provider.h>
+#include <grpcpp/security/tls_credentials_options.h>
+#endif
+
 #include <utils/log.h>
 
 #include "authentication.h"
@@ -32,7 +37,7 @@ static string GetFileContent(string path)
 {
   ifstream ifs(path);
   if (!ifs) {
-    BOOST_LOG_TRIVIAL(fatal) << "File " << path << " not found";
+    GNXI_LOG(SECURITY, fatal) << "File " << path << " not found";
     exit(1);
   }
 
@@ -44,18 +49,73 @@ static string GetFileContent(string path)
   return content;
 }
 
+#ifdef HAVE_TLS_CERTIFICATE_PROVIDER
+/* TlsCredentialsHelper - TLS credentials reloaded when files change.
+ * Files are checked every refresh seconds, new connections use the new
+ * key/certificates, established connections are left untouched.
+ * @param ppath Private Key path
+ * @param cpath certificates path
+ * @param rpath root certificate path
+ * @param client_cert boolean to activate/deactivate client certificate check
+ * @param refresh period of file checks in seconds
+ * @return ServerCredentials for grpc service creation
+ */
+static shared_ptr<ServerCredentials>
+TlsCredentialsHelper(string ppath, string cpath, string rpath,
+                     bool client_cert, unsigned refresh)
+{
+  using namespace grpc::experimental;
+
+  /* Fail early rather than on first handshake */
+  GetFileContent(ppath);
+  GetFileContent(cpath);
+  if (!rpath.empty())
+    GetFileContent(rpath);
+
+  auto provider = make_shared<FileWatcherCertificateProvider>(ppath, cpath,
+                                                              rpath, refresh);
+  TlsServerCredentialsOptions tls_opts(provider);
+
+  tls_opts.watch_identity_key_cert_pairs();
+  if (!rpath.empty())
+    tls_opts.watch_root_certs();
+
+  if (client_cert)
+    tls_opts.set_cert_request_type(
+     GRPC_SSL_REQUEST_AND_REQUIRE_CLIENT_CERTIFICATE_AND_VERIFY);
+  else
+    tls_opts.set_cert_request_type(GRPC_SSL_DONT_REQUEST_CLIENT_CERTIFICATE);
+
+  GNXI_LOG(SECURITY, info) << "TLS certificates reloaded every " << refresh
+                           << " seconds";
+
+  return TlsServerCredentials(tls_opts);
+}
+#endif
+
 /* SslCredentialsHelper -
  * @param ppath Private Key path
  * @param cpath certificates path
  * @param rpath root certificate path
  * @param client_cert boolean to activate/deactivate client certificate check
+ * @param refresh period of certificate reload in seconds, 0 to disable
  * @return ServerCredentials for grpc service creation
  */
 static shared_ptr<ServerCredentials>
-SslCredentialsHelper(string ppath, string cpath, string rpath, bool client_cert)
+SslCredentialsHelper(string ppath, string cpath, string rpath, bool client_cert,
+                     unsigned refresh)
 {
   SslServerCredentialsOptions ssl_opts;
 
+#ifdef HAVE_TLS_CERTIFICATE_PROVIDER
+  if (refresh > 0)
+    return TlsCredentialsHelper(ppath, cpath, rpath, client_cert, refresh);
+#else
+  if (refresh > 0)
+    GNXI_LOG(SECURITY, warning) << "gRPC has no certificate provider, "
+                                << "restart server to load new certificates";
+#endif
+
   if (client_cert)
     ssl_opts.client_certificate_request =
      GRPC_SSL_REQUEST_AND_REQUIRE_CLIENT_CERTIFICATE_AND_VERIFY;
@@ -84,37 +144,49 @@ shared_ptr<ServerCredentials> AuthBuilder::build()
 {
   shared_ptr<ServerCredentials> cred;
 
+  bool userpass = (!username.empty() && !password.empty())
+                  || !credentials_path.empty();
+
   // MUTUAL_TLS
-  if (!private_key_path.empty() && !cert_path.empty()
+  if (!private_key_path.empty() && !cert_path.empty() && !userpass
       && username.empty() && password.empty()) {
-    BOOST_LOG_TRIVIAL(info) << "Mutual TLS authentication";
-    return SslCredentialsHelper(private_key_path, cert_path, root_cert_path, true);
+    GNXI_LOG(SECURITY, info) << "Mutual TLS authentication";
+    return SslCredentialsHelper(private_key_path, cert_path, root_cert_path, true,
+                                cert_refresh);
   }
 
   // USERPASS_TLS
-  if (!private_key_path.empty() && !cert_path.empty()
-      && !username.empty() && !password.empty()) {
-    BOOST_LOG_TRIVIAL(info) << "Username/Password over TLS authentication";
-    cred = SslCredentialsHelper(private_key_path, cert_path, root_cert_path, false);
-    cred->SetAuthMetadataProcessor(
-        make_shared<UserPassAuthenticator>(username, password));
+  if (!private_key_path.empty() && !cert_path.empty() && userpass) {
+    GNXI_LOG(SECURITY, info) << "Username/Password over TLS authentication";
+    auto store = make_shared<CredentialStore>();
+    try {
+      if (!credentials_path.empty())
+        store->load(credentials_path);
+      if (!username.empty() && !password.empty())
+        store->add(username, password);
+    } catch (runtime_error &exc) {
+      GNXI_LOG(SECURITY, fatal) << exc.what();
+      exit(1);
+    }
+    cred = SslCredentialsHelper(private_key_path, cert_path, root_cert_path, false,
+                                cert_refresh);
+    cred->SetAuthMetadataProcessor(make_shared<UserPassAuthenticator>(store));
     return cred;
   }
 
   //INSECURE
   if (insecure) {
-    BOOST_LOG_TRIVIAL(info) << "Insecure authentication";
+    GNXI_LOG(SECURITY, info) << "Insecure authentication";
     return grpc::InsecureServerCredentials();
   }
 
   /* impossible scenario */
-  if (private_key_path.empty() && cert_path.empty()
-      && !username.empty() && !password.empty())
-    BOOST_LOG_TRIVIAL(fatal) << "Impossible to use user/pass auth with"
-                             << " insecure connection";
+  if (private_key_path.empty() && cert_path.empty() && userpass)
+    GNXI_LOG(SECURITY, fatal) << "Impossible to use user/pass auth with"
+                              << " insecure connection";
 
 
-  BOOST_LOG_TRIVIAL(fatal) << "Unsupported Authentication method";
+  GNXI_LOG(SECURITY, fatal) << "Unsupported Authentication method";
 
   exit(1);
 }
@@ -137,6 +209,12 @@ AuthBuilder& AuthBuilder::setRootCertPath(string rootpath)
   return *this;
 }
 
+AuthBuilder& AuthBuilder::setCertRefresh(unsigned seconds)
+{
+  cert_refresh = seconds;
+  return *this;
+}
+
 AuthBuilder& AuthBuilder::setUsername(string user)
 {
   username = user;
@@ -149,6 +227,12 @@ AuthBuilder& AuthBuilder::setPassword(string pass)
   return *this;
 }
 
+AuthBuilder& AuthBuilder::setCredentialsPath(string credentialsPath)
+{
+  credentials_path = credentialsPath;
+  return *this;
+}
+
 AuthBuilder& AuthBuilder::setInsecure(bool mode)
 {
   insecure = mode;
@@ -161,27 +245,32 @@ Status UserPassAuthenticator::Process(const InputMetadata& auth_metadata,
                                       OutputMetadata* consumed_auth_metadata,
                                       OutputMetadata* response_metadata)
 {
-  (void)context; (void)response_metadata; //Unused
+  (void)response_metadata; //Unused
 
   /* Look for username/password fields in Metadata sent by client */
   auto user_kv = auth_metadata.find("username");
   if (user_kv == auth_metadata.end()) {
-    BOOST_LOG_TRIVIAL(error) << "No username field";
+    GNXI_LOG(SECURITY, error) << "No username field";
     return Status(StatusCode::UNAUTHENTICATED, "No username field");
   }
   auto pass_kv = auth_metadata.find("password");
   if (pass_kv == auth_metadata.end()) {
-    BOOST_LOG_TRIVIAL(error) << "No password field";
+    GNXI_LOG(SECURITY, error) << "No password field";
     return Status(StatusCode::UNAUTHENTICATED, "No password field");
   }
 
   /* test if username and password are good */
-  if ( password.compare(pass_kv->second.data()) != 0 ||
-       username.compare(user_kv->second.data()) != 0 ) {
-    BOOST_LOG_TRIVIAL(error) << "Invalid username/password";
+  string username(user_kv->second.data(), user_kv->second.length());
+  string password(pass_kv->second.data(), pass_kv->second.length());
+  if (!credentials->verify(username, password)) {
+    GNXI_LOG(SECURITY, error) << "Invalid username/password";
     return Status(StatusCode::UNAUTHENTICATED, "Invalid username/password");
   }
 
+  /* Username is the identity of the client for authorization */
+  context->AddProperty(USERNAME_PROPERTY, username);
+  context->SetPeerIdentityPropertyName(USERNAME_PROPERTY);
+
   /* Remove username and password key-value from metadata */
   consumed_auth_metadata->insert(make_pair(
         string(user_kv->first.data(), user_kv->first.length()),
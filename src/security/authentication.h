@@ -17,18 +17,23 @@
 #include <grpcpp/security/server_credentials.h>
 #include <grpcpp/security/auth_metadata_processor.h>
 
+#include "credentials.h"
+
+/* AuthContext property holding the name of an authenticated user */
+#define USERNAME_PROPERTY "gnxi_username"
+
 using grpc::ServerCredentials;
 using grpc::SslServerCredentialsOptions;
 using grpc::Status;
 
 /*
  * Authenticate request with username/password comparaison
- * by using metadata fields.
+ * by using metadata fields, against a store of hashed credentials.
  */
 class UserPassAuthenticator final : public grpc::AuthMetadataProcessor {
   public:
-    UserPassAuthenticator(std::string user, std::string pass)
-      : username(user), password(pass) {}
+    UserPassAuthenticator(std::shared_ptr<CredentialStore> store)
+      : credentials(store) {}
     ~UserPassAuthenticator() {}
 
     Status Process(const InputMetadata& auth_metadata,
@@ -37,7 +42,7 @@ class UserPassAuthenticator final : public grpc::AuthMetadataProcessor {
                    OutputMetadata* response_metadata) override;
 
   private:
-    std::string username, password;
+    std::shared_ptr<CredentialStore> credentials;
 };
 
 
@@ -60,16 +65,21 @@ class AuthBuilder {
     AuthBuilder& setKeyPath(std::string keyPath);
     AuthBuilder& setCertPath(std::string certPath);
     AuthBuilder& setRootCertPath(std::string rootPath);
+    /* Period at which certificate files are checked for changes, 0 = never */
+    AuthBuilder& setCertRefresh(unsigned seconds);
 
     /* Username/password */
     AuthBuilder& setUsername(std::string username);
     AuthBuilder& setPassword(std::string password);
+    AuthBuilder& setCredentialsPath(std::string credentialsPath);
 
     AuthBuilder& setInsecure(bool mode);
 
   private:
     std::string private_key_path, cert_path, root_cert_path; //SSL
+    unsigned cert_refresh = 60; //seconds
     std::string username, password;
+    std::string credentials_path; //file of username:hash
     bool insecure = false;
 };
 
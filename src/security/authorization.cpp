@@ -0,0 +1,406 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <utils/log.h>
+#include <utils/xpath.h>
+
+#include "authorization.h"
+
+using namespace std;
+
+string peer_identity(const grpc::ServerContextBase *context)
+{
+  auto auth = context->auth_context();
+
+  if (auth == nullptr)
+    return "";
+
+  auto identity = auth->GetPeerIdentity();
+  if (identity.empty())
+    return "";
+
+  return string(identity[0].data(), identity[0].size());
+}
+
+/* Node names are compared without module prefix, except for the top-level
+ * node which is the one identifying the module. */
+static string normalize(const string &name, bool top)
+{
+  size_t colon;
+
+  if (top || (colon = name.find(':')) == string::npos)
+    return name;
+
+  return name.substr(colon + 1);
+}
+
+/* Request element, prefix and path elements are checked as one path */
+struct RequestElem {
+  const gnmi::PathElem *elem;
+  const string *origin; //set on first element of a path with origin
+  string buf; //normalized name, if different from element name
+  bool owned; //normalized name is in buf
+  bool wildcard; //any node name
+
+  const string& norm() const { return owned ? buf : elem->name(); }
+
+  /* Name as written in the xpath of the request */
+  string name() const
+  {
+    return origin ? *origin + ":" + elem->name() : elem->name();
+  }
+};
+
+/* Names are normalized in place only when they differ, most paths are
+ * checked without any allocation. */
+static void append_elems(const gnmi::Path &path, vector<RequestElem> *elems)
+{
+  for (int i = 0; i < path.elem_size(); i++) {
+    const gnmi::PathElem &elem = path.elem(i);
+    const string *origin = (i == 0 && !path.origin().empty())
+                           ? &path.origin() : nullptr;
+    bool top = elems->empty();
+
+    elems->push_back({&elem, origin, string(), false, false});
+    RequestElem &req = elems->back();
+    if (top && origin) {
+      req.buf = *origin + ":" + elem.name();
+      req.owned = true;
+    } else if (!top && elem.name().find(':') != string::npos) {
+      req.buf = normalize(elem.name(), top);
+      req.owned = true;
+    } else {
+      req.wildcard = elem.name() == "*";
+    }
+  }
+}
+
+/* One matched step of the walk in the trie, steps form a tree by parent */
+struct Authorizer::Step {
+  const Node *node;
+  int parent; //index of parent step, -1 for root
+  size_t depth; //index of matched request element
+  const Branch *branch;
+  const Keys *keys; //rule keys narrowing the request element, or nullptr
+  bool rename; //request wildcard narrowed to the rule node name
+  bool narrowed; //this step or one of its ancestors narrows the request
+  bool granted; //access granted, the walk stops at this step
+};
+
+Authorizer::Authorizer() : everyone(make_shared<Node>()) {}
+
+void Authorizer::insert(Node *root, const Rule &rule)
+{
+  Node *node = root;
+
+  for (int i = 0; i < rule.path.elem_size(); i++) {
+    const gnmi::PathElem &elem = rule.path.elem(i);
+    Branch &branch = node->children[normalize(elem.name(), i == 0)];
+    shared_ptr<Node> *child = nullptr;
+
+    if (branch.name.empty())
+      branch.name = elem.name();
+
+    if (elem.key_size() == 0) {
+      child = &branch.any;
+    } else {
+      Keys keys(elem.key().begin(), elem.key().end());
+      for (auto &keyed : branch.keyed)
+        if (keyed.first == keys)
+          child = &keyed.second;
+      if (child == nullptr) {
+        branch.keyed.emplace_back(keys, nullptr);
+        child = &branch.keyed.back().second;
+      }
+    }
+
+    if (*child == nullptr)
+      *child = make_shared<Node>();
+    node = child->get();
+  }
+
+  node->grant |= rule.access;
+}
+
+/* Compute access granted below every node, return access of the subtree */
+unsigned Authorizer::propagate(Node *node)
+{
+  node->below = 0;
+
+  for (auto &child : node->children) {
+    Branch &branch = child.second;
+    if (branch.any)
+      node->below |= propagate(branch.any.get());
+    for (auto &keyed : branch.keyed)
+      node->below |= propagate(keyed.second.get());
+  }
+
+  return node->grant | node->below;
+}
+
+void Authorizer::load(const string &path)
+{
+  ifstream ifs(path);
+  map<string, vector<Rule>> rules;
+  PathCompiler compiler(0);
+  string line;
+  unsigned lineno = 0;
+
+  if (!ifs)
+    throw runtime_error("Authorization file " + path + " not found");
+
+  while (getline(ifs, line)) {
+    stringstream ss(line);
+    string user, access, xpath;
+    Rule rule;
+
+    lineno++;
+    if (!(ss >> user) || user[0] == '#')
+      continue;
+
+    ss >> access;
+    getline(ss >> ws, xpath);
+
+    if (access == "r")
+      rule.access = READ;
+    else if (access == "w")
+      rule.access = WRITE;
+    else if (access == "rw")
+      rule.access = READ | WRITE;
+    else
+      throw runtime_error(path + ":" + to_string(lineno)
+                          + ": expected USER r|w|rw XPATH");
+
+    try {
+      compiler.parse(xpath, &rule.path);
+    } catch (invalid_argument &exc) {
+      throw runtime_error(path + ":" + to_string(lineno) + ": " + exc.what());
+    }
+
+    rules[user].push_back(rule);
+  }
+
+  /* Rules of '*' apply to every user */
+  everyone = make_shared<Node>();
+  for (auto &rule : rules["*"])
+    insert(everyone.get(), rule);
+  propagate(everyone.get());
+
+  users.clear();
+  for (auto &user : rules) {
+    if (user.first == "*")
+      continue;
+
+    auto root = make_shared<Node>();
+    for (auto &rule : user.second)
+      insert(root.get(), rule);
+    for (auto &rule : rules["*"])
+      insert(root.get(), rule);
+    propagate(root.get());
+
+    users[user.first] = root;
+  }
+
+  GNXI_LOG(SECURITY, info) << "Loaded authorization rules of " << users.size()
+                           << " users from " << path;
+}
+
+/* Append every accessible descendant of node to allowed */
+void Authorizer::descendants(const Node *node, unsigned access,
+                             gnmi::Path *path, vector<gnmi::Path> *allowed)
+{
+  auto visit = [&](const Branch &branch, const Keys *keys, const Node *child) {
+    gnmi::PathElem *elem = path->add_elem();
+
+    elem->set_name(branch.name);
+    if (keys)
+      elem->mutable_key()->insert(keys->begin(), keys->end());
+
+    if (child->grant & access)
+      allowed->push_back(*path);
+    else if (child->below & access)
+      descendants(child, access, path, allowed);
+
+    path->mutable_elem()->RemoveLast();
+  };
+
+  for (auto &child : node->children) {
+    const Branch &branch = child.second;
+    if (branch.any)
+      visit(branch, nullptr, branch.any.get());
+    for (auto &keyed : branch.keyed)
+      visit(branch, &keyed.first, keyed.second.get());
+  }
+}
+
+Authorizer::Decision
+Authorizer::check(const string &user, const gnmi::Path *prefix,
+                  const gnmi::Path &path, Access access,
+                  vector<gnmi::Path> *allowed) const
+{
+  auto it = users.find(user);
+  const Node *root = (it != users.end() ? it->second : everyone).get();
+  /* Scratch buffers, reused by every check of the thread */
+  static thread_local vector<RequestElem> elems;
+  static thread_local vector<Step> steps;
+  static thread_local vector<size_t> granted; //narrowed steps granting access
+  size_t begin = 0, end = 1; //steps matching the previous element
+
+  if (root->grant & access)
+    return PERMIT;
+  if (!(root->below & access))
+    return DENY;
+
+  elems.clear();
+  steps.clear();
+  granted.clear();
+
+  if (prefix != nullptr)
+    append_elems(*prefix, &elems);
+  append_elems(path, &elems);
+
+  steps.push_back({root, -1, 0, nullptr, nullptr, false, false, false});
+
+  /* Record step matching request element, return true on full access */
+  auto visit = [&](size_t parent, size_t depth, const Branch &branch,
+                   const Keys *keys, const Node *node, bool rename) -> bool {
+    bool narrowed = steps[parent].narrowed || rename || keys != nullptr;
+    bool grant = node->grant & access;
+
+    if (grant && !narrowed)
+      return true;
+    if (!grant && !(node->below & access))
+      return false;
+
+    if (grant)
+      granted.push_back(steps.size());
+    steps.push_back({node, static_cast<int>(parent), depth, &branch, keys,
+                     rename, narrowed, grant});
+    return false;
+  };
+
+  /* Follow rules of branch matching request element */
+  auto follow = [&](size_t parent, size_t depth, const Branch &branch,
+                    bool rename) -> bool {
+    const gnmi::PathElem *elem = elems[depth].elem;
+
+    if (branch.any && visit(parent, depth, branch, nullptr, branch.any.get(),
+                            rename))
+      return true;
+
+    for (auto &keyed : branch.keyed) {
+      bool match = true, narrow = false;
+
+      for (auto &key : keyed.first) {
+        auto value = elem->key().find(key.first);
+        if (value == elem->key().end() || value->second == "*") {
+          narrow = true;
+        } else if (value->second != key.second) {
+          match = false;
+          break;
+        }
+      }
+
+      if (match && visit(parent, depth, branch, narrow ? &keyed.first : nullptr,
+                         keyed.second.get(), rename))
+        return true;
+    }
+
+    return false;
+  };
+
+  for (size_t depth = 0; depth < elems.size() && begin < end; depth++) {
+    for (size_t s = begin; s < end; s++) {
+      const Node *node = steps[s].node;
+
+      if (steps[s].granted)
+        continue;
+
+      if (elems[depth].wildcard) {
+        for (auto &child : node->children)
+          if (follow(s, depth, child.second, child.first != "*"))
+            return PERMIT;
+        continue;
+      }
+
+      auto named = node->children.find(elems[depth].norm());
+      if (named != node->children.end()
+          && follow(s, depth, named->second, false))
+        return PERMIT;
+
+      auto any = node->children.find("*");
+      if (any != node->children.end() && follow(s, depth, any->second, false))
+        return PERMIT;
+    }
+
+    begin = end;
+    end = steps.size();
+  }
+
+  /* Steps left matched the whole path, only some descendants are granted */
+  if (begin == end)
+    return granted.empty() ? DENY : PARTIAL;
+  if (allowed == nullptr)
+    return PARTIAL;
+
+  /* Build accessible paths from the steps, request elements narrowed by
+   * rules followed by the remaining request elements or the rule nodes */
+  auto materialize = [&](size_t s, gnmi::Path *out) {
+    vector<size_t> chain;
+
+    for (int i = static_cast<int>(s); steps[i].parent >= 0; i = steps[i].parent)
+      chain.push_back(i);
+
+    for (auto i = chain.rbegin(); i != chain.rend(); ++i) {
+      const Step &step = steps[*i];
+      const RequestElem &req = elems[step.depth];
+      gnmi::PathElem *elem = out->add_elem();
+
+      elem->set_name(step.rename ? step.branch->name : req.name());
+      for (auto &key : req.elem->key())
+        if (key.second != "*")
+          (*elem->mutable_key())[key.first] = key.second;
+      if (step.keys)
+        for (auto &key : *step.keys)
+          (*elem->mutable_key())[key.first] = key.second;
+    }
+  };
+
+  for (auto s : granted) {
+    gnmi::Path out;
+    materialize(s, &out);
+    for (size_t depth = steps[s].depth + 1; depth < elems.size(); depth++) {
+      gnmi::PathElem *elem = out.add_elem();
+      elem->CopyFrom(*elems[depth].elem);
+      elem->set_name(elems[depth].name());
+    }
+    allowed->push_back(out);
+  }
+
+  for (size_t s = begin; s < end; s++) {
+    gnmi::Path out;
+    if (steps[s].granted)
+      continue;
+    materialize(s, &out);
+    descendants(steps[s].node, access, &out, allowed);
+  }
+
+  return allowed->empty() ? DENY : PARTIAL;
+}
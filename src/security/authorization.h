@@ -0,0 +1,123 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTHORIZATION_H
+#define _AUTHORIZATION_H
+
+#include <exception>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <grpcpp/server_context.h>
+#include <proto/gnmi.pb.h>
+
+/* Identity of the client: username, or certificate name with mutual TLS.
+ * Empty for clients of insecure and unix socket listeners. */
+std::string peer_identity(const grpc::ServerContextBase *context);
+
+/* Thrown when data outside of the client rights is about to be written */
+class permission_denied : public std::exception {
+  public:
+    permission_denied(const std::string &what) : msg(what) {}
+    const char* what() const noexcept override { return msg.c_str(); }
+
+  private:
+    std::string msg;
+};
+
+/*
+ * Authorizer - Per-user read and write rules on data paths.
+ *
+ * Rules file contains one "USER ACCESS XPATH" rule per line:
+ *   USER   username, certificate name, or '*' for every client
+ *   ACCESS r, w or rw
+ *   XPATH  absolute path, list keys are optional, e.g.
+ *          /ietf-interfaces:interfaces/interface[name='eth0']
+ * A rule grants access to the whole subtree of its path, '*' matches any
+ * node name. Paths not covered by any rule are denied.
+ *
+ * Rules are compiled at load time in one trie per user, over path elements.
+ * Checking a path walks the trie once, with one hash lookup per element,
+ * and allocates nothing unless access is partial.
+ * It is immutable after load(), hence thread-safe.
+ */
+class Authorizer {
+  public:
+    enum Access {
+      READ = 1,
+      WRITE = 2,
+    };
+
+    enum Decision {
+      DENY,     // nothing under path is accessible
+      PARTIAL,  // only some descendants of path are accessible
+      PERMIT,   // path and its whole subtree are accessible
+    };
+
+    Authorizer();
+    ~Authorizer() {}
+
+    /* Compile rules of file, throw runtime_error on failure */
+    void load(const std::string &path);
+
+    /*
+     * Check access of user to prefix + path.
+     * @param allowed if decision is PARTIAL, filled with the accessible
+     *        descendants of path, as absolute paths without origin.
+     */
+    Decision check(const std::string &user, const gnmi::Path *prefix,
+                   const gnmi::Path &path, Access access,
+                   std::vector<gnmi::Path> *allowed = nullptr) const;
+
+  private:
+    struct Node;
+    typedef std::map<std::string, std::string> Keys;
+
+    /* Children of a node sharing the same name */
+    struct Branch {
+      std::string name; //as written in rule
+      std::shared_ptr<Node> any; //rule without list keys
+      std::vector<std::pair<Keys, std::shared_ptr<Node>>> keyed;
+    };
+
+    struct Node {
+      unsigned grant = 0; //Access granted on subtree
+      unsigned below = 0; //Access granted to some descendants
+      std::unordered_map<std::string, Branch> children; //by normalized name
+    };
+
+    struct Rule {
+      unsigned access;
+      gnmi::Path path;
+    };
+
+    struct Step;
+
+    static void insert(Node *root, const Rule &rule);
+    static unsigned propagate(Node *node);
+    static void descendants(const Node *node, unsigned access,
+                            gnmi::Path *path,
+                            std::vector<gnmi::Path> *allowed);
+
+  private:
+    std::unordered_map<std::string, std::shared_ptr<Node>> users;
+    std::shared_ptr<Node> everyone; //rules of '*' only, for unknown users
+};
+
+#endif //_AUTHORIZATION_H
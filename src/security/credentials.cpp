@@ -0,0 +1,232 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdint>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include <utils/log.h>
+#include <utils/metrics.h>
+
+#include "credentials.h"
+
+using namespace std;
+using namespace chrono;
+
+#define HASH_SCHEME "pbkdf2-sha256"
+#define SALT_LEN 16
+#define DIGEST_LEN 32
+#define HASH_FORMAT_ERROR \
+  "Invalid password hash, expected " HASH_SCHEME "$ITERATIONS$SALT$HASH"
+
+static vector<unsigned char> random_bytes(size_t len)
+{
+  vector<unsigned char> buf(len);
+
+  if (RAND_bytes(buf.data(), static_cast<int>(len)) != 1)
+    throw runtime_error("Not enough entropy to generate random bytes");
+
+  return buf;
+}
+
+static string to_hex(const vector<unsigned char> &buf)
+{
+  static const char digits[] = "0123456789abcdef";
+  string hex;
+
+  for (auto c : buf) {
+    hex += digits[c >> 4];
+    hex += digits[c & 0xf];
+  }
+
+  return hex;
+}
+
+static vector<unsigned char> from_hex(const string &hex)
+{
+  vector<unsigned char> buf;
+
+  if (hex.empty() || hex.size() % 2)
+    throw invalid_argument("Invalid hexadecimal string");
+
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    size_t idx;
+    unsigned long byte = stoul(hex.substr(i, 2), &idx, 16);
+    if (idx != 2)
+      throw invalid_argument("Invalid hexadecimal string");
+    buf.push_back(static_cast<unsigned char>(byte));
+  }
+
+  return buf;
+}
+
+static vector<unsigned char> pbkdf2(const string &password,
+                                    const vector<unsigned char> &salt,
+                                    unsigned iterations, size_t len)
+{
+  vector<unsigned char> digest(len);
+
+  if (PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                        salt.data(), static_cast<int>(salt.size()),
+                        static_cast<int>(iterations), EVP_sha256(),
+                        static_cast<int>(len), digest.data()) != 1)
+    throw runtime_error("PBKDF2 failure");
+
+  return digest;
+}
+
+CredentialStore::CredentialStore()
+  : cache_key(random_bytes(DIGEST_LEN)), verified(VERIFIED_CACHE_SIZE)
+{
+  dummy = decode(hash(to_hex(random_bytes(SALT_LEN))));
+}
+
+string CredentialStore::hash(const string &password, unsigned iterations)
+{
+  vector<unsigned char> salt = random_bytes(SALT_LEN);
+
+  return string(HASH_SCHEME) + "$" + to_string(iterations)
+         + "$" + to_hex(salt)
+         + "$" + to_hex(pbkdf2(password, salt, iterations, DIGEST_LEN));
+}
+
+/* Parse pbkdf2-sha256$ITERATIONS$SALT_HEX$HASH_HEX */
+CredentialStore::Credential CredentialStore::decode(const string &encoded)
+{
+  vector<string> fields;
+  stringstream ss(encoded);
+  string field;
+  Credential cred;
+
+  while (getline(ss, field, '$'))
+    fields.push_back(field);
+
+  if (fields.size() != 4 || fields[0] != HASH_SCHEME)
+    throw invalid_argument(HASH_FORMAT_ERROR);
+
+  try {
+    size_t idx;
+    unsigned long iter = stoul(fields[1], &idx);
+    if (idx != fields[1].size() || iter == 0 || iter > INT32_MAX)
+      throw invalid_argument("Invalid number of iterations");
+    cred.iterations = static_cast<unsigned>(iter);
+    cred.salt = from_hex(fields[2]);
+    cred.digest = from_hex(fields[3]);
+  } catch (logic_error &) { //invalid_argument, out_of_range from stoul
+    throw invalid_argument(HASH_FORMAT_ERROR);
+  }
+
+  return cred;
+}
+
+void CredentialStore::load(const string &path)
+{
+  ifstream ifs(path);
+  string line;
+  unsigned lineno = 0;
+
+  if (!ifs)
+    throw runtime_error("Credentials file " + path + " not found");
+
+  while (getline(ifs, line)) {
+    lineno++;
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    size_t sep = line.find(':');
+    if (sep == string::npos || sep == 0)
+      throw runtime_error(path + ":" + to_string(lineno)
+                          + ": expected username:hash");
+
+    try {
+      users[line.substr(0, sep)] = decode(line.substr(sep + 1));
+    } catch (invalid_argument &exc) {
+      throw runtime_error(path + ":" + to_string(lineno) + ": " + exc.what());
+    }
+  }
+
+  GNXI_LOG(SECURITY, info) << "Loaded " << users.size() << " users from "
+                           << path;
+}
+
+void CredentialStore::add(const string &username, const string &password)
+{
+  users[username] = decode(hash(password));
+}
+
+/* Derive password hash and compare it in constant time */
+bool CredentialStore::check(const Credential &cred, const string &password)
+{
+  vector<unsigned char> digest = pbkdf2(password, cred.salt, cred.iterations,
+                                        cred.digest.size());
+
+  return CRYPTO_memcmp(digest.data(), cred.digest.data(), digest.size()) == 0;
+}
+
+/* Keyed HMAC identifying a username/password pair in cache */
+vector<unsigned char> CredentialStore::mac(const string &username,
+                                           const string &password)
+{
+  string msg = to_string(username.size()) + ":" + username + password;
+  vector<unsigned char> md(EVP_MAX_MD_SIZE);
+  unsigned int len = 0;
+
+  if (!HMAC(EVP_sha256(), cache_key.data(), static_cast<int>(cache_key.size()),
+            reinterpret_cast<const unsigned char*>(msg.data()), msg.size(),
+            md.data(), &len))
+    throw runtime_error("HMAC failure");
+  md.resize(len);
+
+  return md;
+}
+
+bool CredentialStore::verify(const string &username, const string &password)
+{
+  vector<unsigned char> digest = mac(username, password);
+
+  /* Fast path: credentials already verified recently */
+  {
+    lock_guard<mutex> lock(cache_mutex);
+    Verified *entry = verified.get(username);
+    if (entry && entry->expiry > steady_clock::now()
+        && CRYPTO_memcmp(entry->mac.data(), digest.data(),
+                         digest.size()) == 0) {
+      Metrics::get().cacheHit(Metrics::CREDENTIAL_CACHE);
+      return true;
+    }
+  }
+  Metrics::get().cacheMiss(Metrics::CREDENTIAL_CACHE);
+
+  /* Slow path, unknown users are checked against a dummy hash so that
+   * response time does not disclose whether a username exists */
+  auto it = users.find(username);
+  bool ok = check(it != users.end() ? it->second : dummy, password)
+            && it != users.end();
+  if (!ok)
+    return false;
+
+  lock_guard<mutex> lock(cache_mutex);
+  verified.put(username, Verified{digest, steady_clock::now()
+                                          + VERIFIED_CACHE_TTL});
+
+  return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CREDENTIALS_H
+#define _CREDENTIALS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+
+#include <utils/lru.h>
+
+/* Number of recently verified credentials kept in memory */
+#define VERIFIED_CACHE_SIZE 1024
+/* Lifetime of a verified credential in cache */
+#define VERIFIED_CACHE_TTL std::chrono::minutes(5)
+/* PBKDF2 iterations of newly hashed passwords */
+#define PBKDF2_ITERATIONS 100000
+
+/*
+ * CredentialStore - Users allowed to authenticate with username/password.
+ *
+ * Passwords are stored as salted PBKDF2-HMAC-SHA256 hashes, encoded as:
+ *   pbkdf2-sha256$ITERATIONS$SALT_HEX$HASH_HEX
+ * A credentials file contains one "username:hash" line per user, blank
+ * lines and lines starting with '#' are ignored.
+ *
+ * Deriving a hash is deliberately slow, verify() remembers credentials it
+ * has already accepted as a keyed HMAC of username and password, so
+ * that repeated RPCs of a client cost one HMAC. Every comparison of secret
+ * material is done in constant time.
+ */
+class CredentialStore {
+  public:
+    CredentialStore();
+    ~CredentialStore() {}
+
+    /* Load users from a credentials file, throw runtime_error on failure */
+    void load(const std::string &path);
+    /* Add a user from a clear text password */
+    void add(const std::string &username, const std::string &password);
+
+    /* Check username/password, thread-safe */
+    bool verify(const std::string &username, const std::string &password);
+
+    size_t size() const { return users.size(); }
+
+    /* Encode password with a random salt, in credentials file format */
+    static std::string hash(const std::string &password,
+                            unsigned iterations = PBKDF2_ITERATIONS);
+
+  private:
+    struct Credential {
+      unsigned iterations;
+      std::vector<unsigned char> salt;
+      std::vector<unsigned char> digest;
+    };
+
+    struct Verified {
+      std::vector<unsigned char> mac;
+      std::chrono::steady_clock::time_point expiry;
+    };
+
+    static Credential decode(const std::string &encoded);
+    static bool check(const Credential &cred, const std::string &password);
+    std::vector<unsigned char> mac(const std::string &username,
+                                   const std::string &password);
+
+  private:
+    std::map<std::string, Credential> users;
+    Credential dummy; //verified for unknown users, hide their absence
+    std::vector<unsigned char> cache_key; //random HMAC key of cache entries
+    LRUCache<std::string, Verified> verified; //per username
+    std::mutex cache_mutex;
+};
+
+#endif //_CREDENTIALS_H
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "http.h"
+#include "log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/* Limits of requests, they are small administration requests */
+#define HTTP_MAX_HEADER 8192
+#define HTTP_MAX_BODY 65536
+/* Total time to receive a request and send its response */
+#define HTTP_TIMEOUT seconds(5)
+
+HttpServer::HttpServer(const string &addr)
+  : address(addr), listen_fd(-1), stop_pipe{-1, -1} {}
+
+HttpServer::~HttpServer()
+{
+  stop();
+}
+
+void HttpServer::handle(const string &path, Handler handler)
+{
+  handlers[path] = handler;
+}
+
+void HttpServer::start()
+{
+  struct addrinfo hints, *res;
+  size_t colon = address.rfind(':');
+  string host, port;
+  int one = 1, rc;
+
+  if (colon == string::npos)
+    throw runtime_error("HTTP address must be HOST:PORT, got " + address);
+  host = address.substr(0, colon);
+  port = address.substr(colon + 1);
+  if (host.size() > 1 && host.front() == '[' && host.back() == ']')
+    host = host.substr(1, host.size() - 2); //[IPv6]
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                   &hints, &res);
+  if (rc != 0)
+    throw runtime_error("Invalid HTTP address " + address + ": "
+                        + gai_strerror(rc));
+
+  listen_fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    freeaddrinfo(res);
+    throw runtime_error(string("HTTP socket: ") + strerror(errno));
+  }
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  rc = ::bind(listen_fd, res->ai_addr, res->ai_addrlen);
+  freeaddrinfo(res);
+  if (rc < 0 || listen(listen_fd, 16) < 0) {
+    string err = strerror(errno);
+    close(listen_fd);
+    listen_fd = -1;
+    throw runtime_error("HTTP listen on " + address + ": " + err);
+  }
+
+  if (pipe(stop_pipe) < 0)
+    throw runtime_error(string("HTTP pipe: ") + strerror(errno));
+
+  worker = thread(&HttpServer::serve, this);
+  GNXI_LOG(SERVER, info) << "HTTP endpoint listening on " << address;
+}
+
+void HttpServer::stop()
+{
+  if (!worker.joinable())
+    return;
+
+  if (write(stop_pipe[1], "", 1) < 0)
+    GNXI_LOG(SERVER, warning) << "Fail waking up HTTP server";
+  worker.join();
+
+  close(listen_fd);
+  close(stop_pipe[0]);
+  close(stop_pipe[1]);
+  listen_fd = stop_pipe[0] = stop_pipe[1] = -1;
+}
+
+/* 127.0.0.0/8, ::1 and IPv4-mapped 127.0.0.0/8 */
+static bool is_loopback(const struct sockaddr_storage &peer)
+{
+  if (peer.ss_family == AF_INET) {
+    auto in = reinterpret_cast<const struct sockaddr_in*>(&peer);
+    return (ntohl(in->sin_addr.s_addr) >> 24) == 127;
+  }
+
+  if (peer.ss_family == AF_INET6) {
+    auto in6 = reinterpret_cast<const struct sockaddr_in6*>(&peer);
+    return IN6_IS_ADDR_LOOPBACK(&in6->sin6_addr)
+           || (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)
+               && in6->sin6_addr.s6_addr[12] == 127);
+  }
+
+  return false;
+}
+
+void HttpServer::serve()
+{
+  struct pollfd fds[2] = {{listen_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      GNXI_LOG(SERVER, error) << "HTTP poll: " << strerror(errno);
+      return;
+    }
+
+    if (fds[1].revents)
+      return;
+
+    if (fds[0].revents & POLLIN) {
+      struct sockaddr_storage peer;
+      socklen_t len = sizeof(peer);
+      int fd = accept4(listen_fd, reinterpret_cast<struct sockaddr*>(&peer),
+                       &len, SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (fd < 0)
+        continue;
+      serveConnection(fd, is_loopback(peer));
+      close(fd);
+    }
+  }
+}
+
+static string reason(int status)
+{
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    default: return "Internal Server Error";
+  }
+}
+
+/* Decode %XX and '+' of an URL component */
+static string url_decode(const string &in)
+{
+  string out;
+
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size()
+               && isxdigit(in[i + 1]) && isxdigit(in[i + 2])) {
+      out += static_cast<char>(stoi(in.substr(i + 1, 2), nullptr, 16));
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+
+  return out;
+}
+
+static void parse_query(const string &query, map<string, string> *out)
+{
+  stringstream ss(query);
+  string param;
+
+  while (getline(ss, param, '&')) {
+    size_t eq = param.find('=');
+    if (eq == string::npos)
+      (*out)[url_decode(param)] = "";
+    else
+      (*out)[url_decode(param.substr(0, eq))]
+        = url_decode(param.substr(eq + 1));
+  }
+}
+
+/* Wait for events on fd until deadline, false on timeout or error */
+static bool wait_fd(int fd, short events, steady_clock::time_point deadline)
+{
+  struct pollfd pfd = {fd, events, 0};
+
+  while (true) {
+    auto remaining = duration_cast<milliseconds>(deadline
+                                                 - steady_clock::now());
+    if (remaining.count() <= 0)
+      return false;
+
+    int rc = poll(&pfd, 1, static_cast<int>(remaining.count()));
+    if (rc < 0 && errno == EINTR)
+      continue;
+    return rc > 0;
+  }
+}
+
+/* recv on a non-blocking socket, 0 on timeout, error or end of stream */
+static ssize_t recv_until(int fd, char *buf, size_t len,
+                          steady_clock::time_point deadline)
+{
+  while (wait_fd(fd, POLLIN, deadline)) {
+    ssize_t n = recv(fd, buf, len, 0);
+    if (n >= 0)
+      return n;
+    if (errno != EAGAIN && errno != EINTR)
+      return 0;
+  }
+
+  return 0;
+}
+
+static void send_response(int fd, const HttpResponse &response,
+                          steady_clock::time_point deadline)
+{
+  ostringstream out;
+  string data;
+  size_t sent = 0;
+
+  out << "HTTP/1.0 " << response.status << " " << reason(response.status)
+      << "\r\nContent-Type: " << response.content_type
+      << "\r\nContent-Length: " << response.body.size()
+      << "\r\nConnection: close\r\n\r\n" << response.body;
+  data = out.str();
+
+  while (sent < data.size()) {
+    if (!wait_fd(fd, POLLOUT, deadline))
+      return;
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (n <= 0)
+      return;
+    sent += n;
+  }
+}
+
+void HttpServer::serveConnection(int fd, bool loopback)
+{
+  auto deadline = steady_clock::now() + HTTP_TIMEOUT;
+  HttpRequest request;
+  HttpResponse response;
+  string data, line, target, header;
+  size_t end, length = 0;
+  char buf[4096];
+
+  request.loopback = loopback;
+
+  /* Headers */
+  while ((end = data.find("\r\n\r\n")) == string::npos) {
+    ssize_t n = recv_until(fd, buf, sizeof(buf), deadline);
+    if (n <= 0)
+      return;
+    data.append(buf, n);
+    if (data.size() > HTTP_MAX_HEADER) {
+      response.status = 413;
+      send_response(fd, response, deadline);
+      return;
+    }
+  }
+
+  stringstream headers(data.substr(0, end));
+  getline(headers, line);
+  stringstream request_line(line);
+  if (!(request_line >> request.method >> target)) {
+    response.status = 400;
+    send_response(fd, response, deadline);
+    return;
+  }
+
+  while (getline(headers, header)) {
+    size_t colon = header.find(':');
+    if (colon == string::npos)
+      continue;
+    string name = header.substr(0, colon);
+    for (auto &c : name)
+      c = tolower(c);
+    if (name == "content-length") {
+      try {
+        length = stoul(header.substr(colon + 1));
+      } catch (logic_error &) {
+        length = HTTP_MAX_BODY + 1;
+      }
+    }
+  }
+
+  /* Body */
+  if (length > HTTP_MAX_BODY) {
+    response.status = 413;
+    send_response(fd, response, deadline);
+    return;
+  }
+  request.body = data.substr(end + 4);
+  while (request.body.size() < length) {
+    ssize_t n = recv_until(fd, buf, sizeof(buf), deadline);
+    if (n <= 0)
+      return;
+    request.body.append(buf, n);
+  }
+  request.body.resize(length);
+
+  size_t qmark = target.find('?');
+  request.path = url_decode(target.substr(0, qmark));
+  if (qmark != string::npos)
+    parse_query(target.substr(qmark + 1), &request.query);
+
+  auto handler = handlers.find(request.path);
+  if (handler == handlers.end()) {
+    response.status = 404;
+    response.body = "Not found\n";
+  } else {
+    try {
+      handler->second(request, &response);
+    } catch (exception &exc) {
+      response.status = 500;
+      response.body = string(exc.what()) + "\n";
+    }
+  }
+
+  send_response(fd, response, deadline);
+}
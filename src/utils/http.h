@@ -0,0 +1,74 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HTTP_H
+#define _HTTP_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+
+struct HttpRequest {
+  std::string method; //GET, PUT...
+  std::string path; //without query string
+  std::map<std::string, std::string> query; //?key=value&key2=value2
+  std::string body;
+  bool loopback = false; //client connected from a loopback address
+};
+
+struct HttpResponse {
+  int status = 200;
+  std::string content_type = "text/plain; charset=utf-8";
+  std::string body;
+};
+
+/*
+ * HttpServer - Minimal HTTP/1.0 server for local administration endpoints
+ * (metrics scraping, runtime settings).
+ * Connections are served one at a time by a single thread, and closed after
+ * every response. Each connection is given a total deadline, so that a slow
+ * client can not hold the server longer. It is not meant to be exposed beyond
+ * trusted networks.
+ */
+class HttpServer {
+  public:
+    typedef std::function<void(const HttpRequest&, HttpResponse*)> Handler;
+
+    /* @param addr listening address, HOST:PORT or :PORT */
+    HttpServer(const std::string &addr);
+    ~HttpServer();
+
+    /* Register handler of a path, before start() */
+    void handle(const std::string &path, Handler handler);
+
+    /* Listen and serve in a background thread, throw runtime_error */
+    void start();
+    void stop();
+
+  private:
+    void serve();
+    void serveConnection(int fd, bool loopback);
+
+  private:
+    std::string address;
+    std::map<std::string, Handler> handlers;
+    int listen_fd;
+    int stop_pipe[2]; //wakes up serving thread on stop
+    std::thread worker;
+};
+
+#endif // _HTTP_H
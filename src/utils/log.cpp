@@ -14,47 +14,302 @@
  * limitations under the License.
  */
 
+#include <condition_variable>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
+
+#include <boost/core/null_deleter.hpp>
+#include <boost/log/attributes/current_thread_id.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/support/date_time.hpp>
+#include <boost/log/utility/setup/common_attributes.hpp>
 
 #include "log.h"
 
-static void _boost_set_log_level(int lvl)
-{
-  logging::trivial::severity_level l;
-
-  switch (lvl) {
-    case 0: //no log
-      l = logging::trivial::fatal;
-      break;
-    case 1: //only error message
-      l = logging::trivial::error;
-      break;
-    case 2: //log error and warning
-      l = logging::trivial::warning;
-      break;
-    case 3: //log error, warning, and informational
-      l = logging::trivial::info;
-      break;
-    case 4: //log error, warning, informational and debug
-      l = logging::trivial::debug;
-      break;
-    default:
-      std::cerr << "Unused log level" << std::endl;
-      exit(1);
-  }
+namespace expr = logging::expressions;
+namespace sinks = logging::sinks;
+
+/* Records waiting to be written, must be a power of 2 */
+#define LOG_QUEUE_SIZE 8192
+/* Minimum severity of components until levels are set, as Log() default */
+#define LOG_DEFAULT_THRESHOLD logging::trivial::info
+
+/* Constant initialized, messages logged during static initialization are
+ * filtered like others */
+std::atomic<int> Log::thresholds[Log::COMPONENT_MAX] = {
+  {LOG_DEFAULT_THRESHOLD}, {LOG_DEFAULT_THRESHOLD}, {LOG_DEFAULT_THRESHOLD},
+  {LOG_DEFAULT_THRESHOLD}, {LOG_DEFAULT_THRESHOLD}, {LOG_DEFAULT_THRESHOLD}
+};
+static_assert(Log::COMPONENT_MAX == 6,
+              "every component must have a default threshold");
+
+static std::atomic<uint64_t> dropped_records(0);
+
+/*
+ * RingQueue - Queueing strategy of the asynchronous sink frontend.
+ * Bounded lock-free ring buffer (Vyukov's MPMC queue): logging threads never
+ * wait. When the ring is full, the record is dropped and counted.
+ * The writing thread sleeps on a condition variable when the ring is empty,
+ * the first record queued afterwards takes the lock once to wake it up.
+ */
+class RingQueue {
+  protected:
+    RingQueue() : head(0), tail(0), sleeping(false), interrupted(false)
+    {
+      for (size_t i = 0; i < LOG_QUEUE_SIZE; i++)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    template <typename ArgsT>
+    explicit RingQueue(const ArgsT &) : RingQueue() {}
+
+    void enqueue(const logging::record_view &rec)
+    {
+      if (!push(rec)) {
+        dropped_records.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+
+      /* Pairs with the fence of dequeue_ready: either the writer sees the
+       * record, or we see it sleeping */
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleeping.load(std::memory_order_relaxed)
+          && sleeping.exchange(false)) {
+        std::lock_guard<std::mutex> lock(mtx);
+        idle.notify_one();
+      }
+    }
+
+    bool try_enqueue(const logging::record_view &rec)
+    {
+      enqueue(rec);
+      return true;
+    }
+
+    bool try_dequeue_ready(logging::record_view &rec) { return pop(rec); }
+    bool try_dequeue(logging::record_view &rec) { return pop(rec); }
+
+    /* Wait for a record, return false when interrupted */
+    bool dequeue_ready(logging::record_view &rec)
+    {
+      while (!pop(rec)) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (interrupted) {
+          interrupted = false;
+          return false;
+        }
+
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (pop(rec)) {
+          sleeping.store(false, std::memory_order_relaxed);
+          return true;
+        }
+        idle.wait(lock, [this] {
+          return !sleeping.load(std::memory_order_relaxed) || interrupted;
+        });
+        sleeping.store(false, std::memory_order_relaxed);
+      }
+
+      return true;
+    }
+
+    void interrupt_dequeue()
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      interrupted = true;
+      idle.notify_one();
+    }
+
+  private:
+    bool push(const logging::record_view &rec)
+    {
+      size_t pos = head.load(std::memory_order_relaxed);
+      Slot *slot;
 
-  logging::core::get()->set_filter(
-    logging::trivial::severity >= l
-  );
+      while (true) {
+        slot = &slots[pos & (LOG_QUEUE_SIZE - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq == pos) {
+          if (head.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed))
+            break;
+        } else if (seq < pos) {
+          return false; //full
+        } else {
+          pos = head.load(std::memory_order_relaxed);
+        }
+      }
+
+      slot->rec = rec;
+      slot->seq.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(logging::record_view &rec)
+    {
+      size_t pos = tail.load(std::memory_order_relaxed);
+      Slot *slot;
+
+      while (true) {
+        slot = &slots[pos & (LOG_QUEUE_SIZE - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq == pos + 1) {
+          if (tail.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed))
+            break;
+        } else if (seq < pos + 1) {
+          return false; //empty
+        } else {
+          pos = tail.load(std::memory_order_relaxed);
+        }
+      }
+
+      rec = std::move(slot->rec);
+      slot->seq.store(pos + LOG_QUEUE_SIZE, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    struct Slot {
+      std::atomic<size_t> seq; //pos + 1 when filled, pos + size when freed
+      logging::record_view rec;
+    };
+
+    Slot slots[LOG_QUEUE_SIZE];
+    std::atomic<size_t> head; //next position to fill
+    char pad[64]; //head and tail are written by different threads
+    std::atomic<size_t> tail; //next position to consume
+
+    std::atomic<bool> sleeping; //writer waits on idle for a record
+    std::mutex mtx; //protects interrupted, held by the writer until it waits
+    std::condition_variable idle;
+    bool interrupted;
+};
+
+typedef sinks::asynchronous_sink<sinks::text_ostream_backend, RingQueue>
+  AsyncSink;
+
+static boost::shared_ptr<AsyncSink> sink;
+
+/* Write queued records on exit */
+static void stop_sink()
+{
+  sink->stop();
+  sink->flush();
 }
 
+/* Replace boost default synchronous sink by a sink writing to stderr in a
+ * background thread. Time and thread are attributes of the record, they are
+ * those of the logging thread. */
+static void setup_sink()
+{
+  auto backend = boost::make_shared<sinks::text_ostream_backend>();
+
+  backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog,
+                                                      boost::null_deleter()));
+  backend->auto_flush(true);
+
+  sink = boost::make_shared<AsyncSink>(backend);
+  sink->set_formatter(expr::stream
+    << "[" << expr::format_date_time<boost::posix_time::ptime>(
+                "TimeStamp", "%Y-%m-%d %H:%M:%S.%f")
+    << "] [" << expr::attr<logging::attributes::current_thread_id::value_type>(
+                  "ThreadID")
+    << "] [" << logging::trivial::severity
+    << "] [" << expr::attr<std::string>("Channel")
+    << "] " << expr::smessage);
+
+  logging::add_common_attributes();
+  logging::core::get()->add_sink(sink);
+  std::atexit(stop_sink);
+}
+
+/* lvl 0 (fatal) to 4 (debug) */
+static bool valid_level(int lvl)
+{
+  return lvl >= 0 && lvl <= 4;
+}
+
+static int to_severity(int lvl)
+{
+  return logging::trivial::fatal - lvl;
+}
 
 Log::Log(int lvl)
 {
-  _boost_set_log_level(lvl);
+  static std::once_flag once;
+
+  std::call_once(once, setup_sink);
+  setLevel(lvl);
 }
 
 void Log::setLevel(int lvl)
 {
-  _boost_set_log_level(lvl);
+  if (!setLevel("all", lvl)) {
+    std::cerr << "Unused log level" << std::endl;
+    exit(1);
+  }
+}
+
+bool Log::setLevel(const std::string &component, int lvl)
+{
+  bool found = false;
+
+  if (!valid_level(lvl))
+    return false;
+
+  for (int i = 0; i < COMPONENT_MAX; i++) {
+    if (component == "all" || component == componentName(Component(i))) {
+      thresholds[i].store(to_severity(lvl), std::memory_order_relaxed);
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+int Log::level(Component component)
+{
+  return logging::trivial::fatal
+         - thresholds[component].load(std::memory_order_relaxed);
+}
+
+static Log::Logger* make_loggers()
+{
+  static Log::Logger loggers[Log::COMPONENT_MAX];
+
+  for (int i = 0; i < Log::COMPONENT_MAX; i++)
+    loggers[i].channel(Log::componentName(Log::Component(i)));
+
+  return loggers;
+}
+
+Log::Logger& Log::logger(Component component)
+{
+  static Logger *loggers = make_loggers();
+
+  return loggers[component];
+}
+
+const char* Log::componentName(Component component)
+{
+  static const char *names[COMPONENT_MAX] = {
+    "server", "get", "set", "subscribe", "encode", "security"
+  };
+
+  return names[component];
+}
+
+uint64_t Log::dropped()
+{
+  return dropped_records.load(std::memory_order_relaxed);
+}
+
+void Log::flush()
+{
+  if (sink)
+    sink->flush();
 }
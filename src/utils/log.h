@@ -17,23 +17,51 @@
 #ifndef _LOG_H
 #define _LOG_H
 
+#include <atomic>
+#include <cstdint>
+#include <string>
+
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sources/severity_channel_logger.hpp>
 
 namespace logging = boost::log;
 
 /*
- * Pick your severity
- * BOOST_LOG_TRIVIAL(trace) << "A trace severity message";
- * BOOST_LOG_TRIVIAL(debug) << "A debug severity message";
- * BOOST_LOG_TRIVIAL(info) << "An informational severity message";
- * BOOST_LOG_TRIVIAL(warning) << "A warning severity message";
- * BOOST_LOG_TRIVIAL(error) << "An error severity message";
- * BOOST_LOG_TRIVIAL(fatal) << "A fatal severity message";
+ * Pick your component and severity
+ * GNXI_LOG(SUBSCRIBE, trace) << "A trace severity message";
+ * GNXI_LOG(SUBSCRIBE, debug) << "A debug severity message";
+ * GNXI_LOG(SUBSCRIBE, info) << "An informational severity message";
+ * GNXI_LOG(SUBSCRIBE, warning) << "A warning severity message";
+ * GNXI_LOG(SUBSCRIBE, error) << "An error severity message";
+ * GNXI_LOG(SUBSCRIBE, fatal) << "A fatal severity message";
+ *
+ * Messages below the level of their component are discarded before being
+ * formatted. Others are queued and written to stderr by a background thread,
+ * they are dropped when the queue is full rather than blocking the caller.
 */
+#define GNXI_LOG(component, lvl) \
+  for (bool _log_on = Log::enabled(Log::component, logging::trivial::lvl); \
+       _log_on; _log_on = false) \
+    BOOST_LOG_SEV(Log::logger(Log::component), logging::trivial::lvl)
+
 class Log {
   public:
+    /* Components with their own log level */
+    enum Component {
+      SERVER,     // server setup, capabilities, administration endpoint
+      GET,
+      SET,
+      SUBSCRIBE,
+      ENCODE,     // YANG models and data encodings
+      SECURITY,   // authentication and authorization
+      COMPONENT_MAX
+    };
+
+    typedef logging::sources::severity_channel_logger_mt<
+      logging::trivial::severity_level, std::string> Logger;
+
     /*
      * lvl 0 : fatal
      * lvl 1 : error
@@ -44,7 +72,30 @@ class Log {
     Log(int lvl = 3); //default to 'info' log
     ~Log() {}
 
+    /* Set level of every component, exit on invalid level */
     static void setLevel(int lvl);
+    /* Set level of one component by name, or of every component with "all".
+     * Return false on unknown component or invalid level. */
+    static bool setLevel(const std::string &component, int lvl);
+    static int level(Component component);
+
+    static bool enabled(Component component,
+                        logging::trivial::severity_level sev)
+    {
+      return sev >= thresholds[component].load(std::memory_order_relaxed);
+    }
+
+    static Logger& logger(Component component);
+    static const char* componentName(Component component);
+
+    /* Number of messages dropped because the queue was full */
+    static uint64_t dropped();
+
+    /* Write queued messages */
+    static void flush();
+
+  private:
+    static std::atomic<int> thresholds[COMPONENT_MAX]; //minimum severity
 };
 
 #endif // _LOG_H
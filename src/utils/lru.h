@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LRU_H
+#define _LRU_H
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/*
+ * LRUCache - Bounded key/value cache evicting the least recently used entry.
+ * Lookups and insertions are O(1). It is not thread-safe, callers must
+ * serialize accesses.
+ */
+template <typename K, typename V>
+class LRUCache {
+  public:
+    LRUCache(size_t capacity) : cap(capacity) {}
+    ~LRUCache() {}
+
+    /* Return cached value and mark it most recently used, nullptr if absent */
+    V* get(const K &key)
+    {
+      auto it = index.find(key);
+      if (it == index.end())
+        return nullptr;
+
+      entries.splice(entries.begin(), entries, it->second);
+      return &it->second->second;
+    }
+
+    /* Insert or replace value, evicting the least recently used entry */
+    void put(const K &key, const V &value)
+    {
+      auto it = index.find(key);
+      if (it != index.end()) {
+        it->second->second = value;
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+      }
+
+      entries.emplace_front(key, value);
+      index[key] = entries.begin();
+
+      if (entries.size() > cap) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+      }
+    }
+
+    void clear() { entries.clear(); index.clear(); }
+    size_t size() const { return entries.size(); }
+    size_t capacity() const { return cap; }
+
+  private:
+    typedef std::list<std::pair<K, V>> List;
+
+    List entries; //most recently used first
+    std::unordered_map<K, typename List::iterator> index;
+    size_t cap;
+};
+
+#endif // _LRU_H
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sstream>
+
+#include "log.h"
+#include "metrics.h"
+
+using namespace std;
+using namespace chrono;
+
+const double Histogram::bounds[Histogram::BUCKETS] = {
+  0.00005, 0.0001, 0.00025, 0.0005,
+  0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+  1, 2.5, 5, 10
+};
+
+Histogram::Histogram() : cnt(0), sum_ns(0)
+{
+  for (auto &b : buckets)
+    b.store(0, memory_order_relaxed);
+}
+
+void Histogram::observe(steady_clock::duration elapsed)
+{
+  uint64_t ns = duration_cast<nanoseconds>(elapsed).count();
+  double seconds = ns / 1e9;
+  int i = 0;
+
+  while (i < BUCKETS && seconds > bounds[i])
+    i++;
+
+  buckets[i].fetch_add(1, memory_order_relaxed);
+  cnt.fetch_add(1, memory_order_relaxed);
+  sum_ns.fetch_add(ns, memory_order_relaxed);
+}
+
+double Histogram::sum() const
+{
+  return sum_ns.load(memory_order_relaxed) / 1e9;
+}
+
+Metrics& Metrics::get()
+{
+  static Metrics metrics;
+
+  return metrics;
+}
+
+void Metrics::response(Rpc rpc, int code)
+{
+  if (code < 0 || code >= CODE_MAX)
+    code = 2; //UNKNOWN
+
+  responses[rpc][code].inc();
+}
+
+void Metrics::dropped(SubscriptionStats &stats, uint64_t count)
+{
+  stats.dropped.inc(count);
+  dropped_updates.inc(count);
+}
+
+void Metrics::missed(SubscriptionStats &stats, uint64_t count)
+{
+  stats.missed.inc(count);
+  missed_samples.inc(count);
+}
+
+void Metrics::subscribe(shared_ptr<SubscriptionStats> stats)
+{
+  lock_guard<mutex> lock(subs_mutex);
+
+  stats->id = next_id++;
+  subs[stats->id] = stats;
+}
+
+void Metrics::unsubscribe(uint64_t id)
+{
+  lock_guard<mutex> lock(subs_mutex);
+
+  subs.erase(id);
+}
+
+vector<shared_ptr<const SubscriptionStats>> Metrics::subscriptions() const
+{
+  vector<shared_ptr<const SubscriptionStats>> list;
+  lock_guard<mutex> lock(subs_mutex);
+
+  for (auto &sub : subs)
+    list.push_back(sub.second);
+
+  return list;
+}
+
+const char* Metrics::rpcName(Rpc rpc)
+{
+  static const char *names[RPC_MAX] = {
+    "Capabilities", "Get", "Set", "Subscribe"
+  };
+
+  return names[rpc];
+}
+
+const char* Metrics::phaseName(Phase phase)
+{
+  static const char *names[PHASE_MAX] = {
+    "sysrepo_read", "encode", "serialize", "write", "tick"
+  };
+
+  return names[phase];
+}
+
+const char* Metrics::codeName(int code)
+{
+  static const char *names[CODE_MAX] = {
+    "OK", "CANCELLED", "UNKNOWN", "INVALID_ARGUMENT", "DEADLINE_EXCEEDED",
+    "NOT_FOUND", "ALREADY_EXISTS", "PERMISSION_DENIED", "RESOURCE_EXHAUSTED",
+    "FAILED_PRECONDITION", "ABORTED", "OUT_OF_RANGE", "UNIMPLEMENTED",
+    "INTERNAL", "UNAVAILABLE", "DATA_LOSS", "UNAUTHENTICATED"
+  };
+
+  return names[code];
+}
+
+const char* Metrics::cacheName(Cache cache)
+{
+  static const char *names[CACHE_MAX] = {
+    "paths", "capabilities", "credentials"
+  };
+
+  return names[cache];
+}
+
+/* Write histogram series, buckets are cumulative in Prometheus format */
+static void write_histogram(ostream &out, const string &name,
+                            const string &labels, const Histogram &hist)
+{
+  uint64_t cumulative = 0;
+
+  for (int i = 0; i < Histogram::BUCKETS; i++) {
+    cumulative += hist.bucket(i);
+    out << name << "_bucket{" << labels << ",le=\"" << Histogram::bounds[i]
+        << "\"} " << cumulative << "\n";
+  }
+  cumulative += hist.bucket(Histogram::BUCKETS);
+  out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << cumulative
+      << "\n";
+  out << name << "_sum{" << labels << "} " << hist.sum() << "\n";
+  out << name << "_count{" << labels << "} " << cumulative << "\n";
+}
+
+string Metrics::prometheus() const
+{
+  ostringstream out;
+
+  out << "# HELP gnxi_rpc_requests_total Number of gNMI RPCs received.\n"
+      << "# TYPE gnxi_rpc_requests_total counter\n";
+  for (int rpc = 0; rpc < RPC_MAX; rpc++)
+    out << "gnxi_rpc_requests_total{rpc=\"" << rpcName(Rpc(rpc)) << "\"} "
+        << requests[rpc].value() << "\n";
+
+  out << "# HELP gnxi_rpc_responses_total Number of gNMI RPCs completed, "
+      << "by status code.\n"
+      << "# TYPE gnxi_rpc_responses_total counter\n";
+  for (int rpc = 0; rpc < RPC_MAX; rpc++)
+    for (int code = 0; code < CODE_MAX; code++)
+      if (responses[rpc][code].value() > 0)
+        out << "gnxi_rpc_responses_total{rpc=\"" << rpcName(Rpc(rpc))
+            << "\",code=\"" << codeName(code) << "\"} "
+            << responses[rpc][code].value() << "\n";
+
+  out << "# HELP gnxi_rpc_sent_bytes_total Size of gNMI responses sent.\n"
+      << "# TYPE gnxi_rpc_sent_bytes_total counter\n";
+  for (int rpc = 0; rpc < RPC_MAX; rpc++)
+    out << "gnxi_rpc_sent_bytes_total{rpc=\"" << rpcName(Rpc(rpc)) << "\"} "
+        << bytes_sent[rpc].value() << "\n";
+
+  out << "# HELP gnxi_rpc_duration_seconds Latency of unary gNMI RPCs, "
+      << "and of every Subscribe sample.\n"
+      << "# TYPE gnxi_rpc_duration_seconds histogram\n";
+  for (int rpc = 0; rpc < RPC_MAX; rpc++)
+    write_histogram(out, "gnxi_rpc_duration_seconds",
+                    string("rpc=\"") + rpcName(Rpc(rpc)) + "\"",
+                    rpc_duration[rpc]);
+
+  out << "# HELP gnxi_phase_duration_seconds Latency of request processing "
+      << "phases.\n"
+      << "# TYPE gnxi_phase_duration_seconds histogram\n";
+  for (int phase = 0; phase < PHASE_MAX; phase++)
+    write_histogram(out, "gnxi_phase_duration_seconds",
+                    string("phase=\"") + phaseName(Phase(phase)) + "\"",
+                    phase_duration[phase]);
+
+  out << "# HELP gnxi_active_streams Number of Subscribe RPCs in progress.\n"
+      << "# TYPE gnxi_active_streams gauge\n"
+      << "gnxi_active_streams " << active_streams.value() << "\n";
+
+  out << "# HELP gnxi_subscribe_dropped_updates_total Number of Subscribe "
+      << "updates not sent because writing the stream failed.\n"
+      << "# TYPE gnxi_subscribe_dropped_updates_total counter\n"
+      << "gnxi_subscribe_dropped_updates_total " << dropped_updates.value()
+      << "\n";
+
+  out << "# HELP gnxi_subscribe_missed_samples_total Number of sample "
+      << "deadlines missed because sampling overran the interval.\n"
+      << "# TYPE gnxi_subscribe_missed_samples_total counter\n"
+      << "gnxi_subscribe_missed_samples_total " << missed_samples.value()
+      << "\n";
+
+  out << "# HELP gnxi_cache_hits_total Number of lookups found in cache.\n"
+      << "# TYPE gnxi_cache_hits_total counter\n";
+  for (int cache = 0; cache < CACHE_MAX; cache++)
+    out << "gnxi_cache_hits_total{cache=\"" << cacheName(Cache(cache)) << "\"} "
+        << cache_hits[cache].value() << "\n";
+
+  out << "# HELP gnxi_cache_misses_total Number of lookups not found in "
+      << "cache.\n"
+      << "# TYPE gnxi_cache_misses_total counter\n";
+  for (int cache = 0; cache < CACHE_MAX; cache++)
+    out << "gnxi_cache_misses_total{cache=\"" << cacheName(Cache(cache))
+        << "\"} " << cache_misses[cache].value() << "\n";
+
+  out << "# HELP gnxi_log_dropped_total Number of log messages dropped on "
+      << "full queue.\n"
+      << "# TYPE gnxi_log_dropped_total counter\n"
+      << "gnxi_log_dropped_total " << Log::dropped() << "\n";
+
+  return out.str();
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Monotonic counter */
+class Counter {
+  public:
+    Counter() : val(0) {}
+
+    void inc(uint64_t n = 1) { val.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return val.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> val;
+};
+
+/* Value going up and down */
+class Gauge {
+  public:
+    Gauge() : val(0) {}
+
+    void inc() { val.fetch_add(1, std::memory_order_relaxed); }
+    void dec() { val.fetch_sub(1, std::memory_order_relaxed); }
+    int64_t value() const { return val.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int64_t> val;
+};
+
+/* Latency histogram, over fixed buckets from 50us to 10s */
+class Histogram {
+  public:
+    static const int BUCKETS = 17;
+    static const double bounds[BUCKETS]; //upper bounds in seconds
+
+    Histogram();
+
+    void observe(std::chrono::steady_clock::duration elapsed);
+
+    /* Number of observations in bucket i (not cumulative), i = BUCKETS
+     * for observations above every bound */
+    uint64_t bucket(int i) const
+    {
+      return buckets[i].load(std::memory_order_relaxed);
+    }
+    uint64_t count() const { return cnt.load(std::memory_order_relaxed); }
+    double sum() const; //in seconds
+
+  private:
+    std::atomic<uint64_t> buckets[BUCKETS + 1];
+    std::atomic<uint64_t> cnt;
+    std::atomic<uint64_t> sum_ns;
+};
+
+/* Record time elapsed in its scope in a histogram */
+class LatencyTimer {
+  public:
+    LatencyTimer(Histogram &hist)
+      : histogram(hist), start(std::chrono::steady_clock::now()) {}
+    ~LatencyTimer()
+    {
+      histogram.observe(std::chrono::steady_clock::now() - start);
+    }
+
+  private:
+    Histogram &histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+/* Statistics of one Subscribe RPC */
+struct SubscriptionStats {
+  uint64_t id = 0;
+  std::string peer; //client address
+  std::string user; //client identity, empty if not authenticated
+  std::string mode; //stream, once or poll
+  std::vector<std::string> paths; //subscribed xpaths
+  std::vector<uint64_t> intervals; //sample intervals in ns, of STREAM mode
+
+  Counter samples; //samples taken, whatever their number of chunks
+  Counter bytes; //bytes of responses sent
+  Counter dropped; //updates not sent because writing the stream failed
+  Counter missed; //sample deadlines missed because sampling overran
+  Histogram latency; //time to build a notification
+  Histogram lateness; //delay of samples after their deadline
+};
+
+/*
+ * Metrics - In-process statistics of gnxi_server.
+ * Every metric is preallocated, recording one is a relaxed atomic operation
+ * without lookup or lock, so it can be done on hot paths.
+ */
+class Metrics {
+  public:
+    enum Rpc { CAPABILITIES, GET, SET, SUBSCRIBE, RPC_MAX };
+
+    enum Phase {
+      SYSREPO_READ, // reading trees from the datastore
+      ENCODE,       // encoding datastore trees in JSON
+      SERIALIZE,    // building gNMI messages from encoded data
+      WRITE,        // writing messages on Subscribe streams
+      TICK,         // sampling subscriptions due in a tick of a stream
+      PHASE_MAX
+    };
+
+    enum Cache {
+      PATH_CACHE,       // gNMI paths compiled to xpaths
+      CAPABILITY_CACHE, // CapabilityResponse
+      CREDENTIAL_CACHE, // verified passwords
+      CACHE_MAX
+    };
+
+    /* gRPC status codes, from OK to UNAUTHENTICATED */
+    static const int CODE_MAX = 17;
+
+    static Metrics& get();
+
+    /* Count an RPC and its status code */
+    void request(Rpc rpc) { requests[rpc].inc(); }
+    void response(Rpc rpc, int code);
+    void sent(Rpc rpc, size_t bytes) { bytes_sent[rpc].inc(bytes); }
+
+    /* Count updates of a subscription lost on failed writes, and sample
+     * deadlines it missed, also in the subscription stats */
+    void dropped(SubscriptionStats &stats, uint64_t count);
+    void missed(SubscriptionStats &stats, uint64_t count);
+
+    void cacheHit(Cache cache) { cache_hits[cache].inc(); }
+    void cacheMiss(Cache cache) { cache_misses[cache].inc(); }
+
+    Histogram& duration(Rpc rpc) { return rpc_duration[rpc]; }
+    Histogram& phase(Phase phase) { return phase_duration[phase]; }
+    Gauge& streams() { return active_streams; }
+
+    const Counter& requestCount(Rpc rpc) const { return requests[rpc]; }
+    const Counter& responseCount(Rpc rpc, int code) const
+    {
+      return responses[rpc][code];
+    }
+    const Histogram& duration(Rpc rpc) const { return rpc_duration[rpc]; }
+    const Histogram& phase(Phase phase) const { return phase_duration[phase]; }
+    const Gauge& streams() const { return active_streams; }
+    const Counter& sentBytes(Rpc rpc) const { return bytes_sent[rpc]; }
+    const Counter& droppedUpdates() const { return dropped_updates; }
+    const Counter& missedSamples() const { return missed_samples; }
+    const Counter& cacheHits(Cache cache) const { return cache_hits[cache]; }
+    const Counter& cacheMisses(Cache cache) const
+    {
+      return cache_misses[cache];
+    }
+
+    /* Subscribe RPCs are listed with their statistics from registration
+     * to unregistration, stats fields must be set before registration. */
+    void subscribe(std::shared_ptr<SubscriptionStats> stats);
+    void unsubscribe(uint64_t id);
+    std::vector<std::shared_ptr<const SubscriptionStats>> subscriptions() const;
+
+    static const char* rpcName(Rpc rpc);
+    static const char* phaseName(Phase phase);
+    static const char* codeName(int code);
+    static const char* cacheName(Cache cache);
+
+    /* Metrics in Prometheus text exposition format */
+    std::string prometheus() const;
+
+  private:
+    Metrics() : next_id(1) {}
+
+    Counter requests[RPC_MAX];
+    Counter responses[RPC_MAX][CODE_MAX];
+    Histogram rpc_duration[RPC_MAX];
+    Histogram phase_duration[PHASE_MAX];
+    Gauge active_streams;
+    Counter bytes_sent[RPC_MAX];
+    Counter dropped_updates;
+    Counter missed_samples;
+    Counter cache_hits[CACHE_MAX];
+    Counter cache_misses[CACHE_MAX];
+
+    mutable std::mutex subs_mutex; //protects subs and next_id
+    std::map<uint64_t, std::shared_ptr<SubscriptionStats>> subs;
+    uint64_t next_id;
+};
+
+#endif // _METRICS_H
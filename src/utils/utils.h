@@ -18,8 +18,12 @@
 #define _UTILS_H
 
 #include <chrono>
+#include <map>
+#include <stdexcept>
 #include <string>
 
+#include <proto/gnmi.pb.h>
+
 using std::chrono::system_clock;
 using std::chrono::duration_cast;
 using std::chrono::nanoseconds;
@@ -33,10 +37,26 @@ inline uint64_t get_time_nanosec()
   return ts.count();
 }
 
+/*
+ * Quote a list key value for a xpath predicate.
+ * XPath 1.0 literals have no escape sequence: a value containing double
+ * quotes is enclosed in single quotes, a value containing both can not be
+ * expressed.
+ */
+inline std::string xpath_quote(const std::string &value)
+{
+  if (value.find('"') == std::string::npos)
+    return "\"" + value + "\"";
+  if (value.find('\'') == std::string::npos)
+    return "'" + value + "'";
+
+  throw std::invalid_argument("Key value with both quote types: " + value);
+}
+
 /* Conversion methods between xpaths and gNMI paths */
-inline string gnmi_to_xpath(const Path& path)
+inline std::string gnmi_to_xpath(const gnmi::Path& path)
 {
-  string str = "";
+  std::string str;
   bool first = true;
 
   if (path.elem_size() <= 0)
@@ -48,13 +68,32 @@ inline string gnmi_to_xpath(const Path& path)
     if (first) {
       first = false;
       /* YANG namespace is specified in origin field */
-      if (!path.origin().empty())
-        str += path.origin() + ":";
+      if (!path.origin().empty()) {
+        str += path.origin();
+        str += ":";
+      }
     }
 
     str += node.name();
-    for (auto key : node.key()) //0 or 1 iteration
-      str += "[" + key.first + "=\"" + key.second + "\"]";
+
+    auto predicate = [&str](const std::string &name, const std::string &val) {
+      str += "[";
+      str += name;
+      str += "=";
+      str += xpath_quote(val);
+      str += "]";
+    };
+
+    /* Keys are sorted to give the same xpath for the same gNMI path */
+    if (node.key_size() > 1) {
+      std::map<std::string, std::string> keys(node.key().begin(),
+                                              node.key().end());
+      for (auto &key : keys)
+        predicate(key.first, key.second);
+    } else {
+      for (auto &key : node.key())
+        predicate(key.first, key.second);
+    }
   }
 
   return str;
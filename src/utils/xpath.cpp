@@ -0,0 +1,244 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include "metrics.h"
+#include "xpath.h"
+#include "utils.h"
+
+using namespace std;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::io::CodedOutputStream;
+
+/*
+ * Serialize a gNMI path, preceded by its length, in a cache key.
+ * Serialization must be deterministic because PathElem keys are a map.
+ */
+static void append_key(const gnmi::Path &path, string *key)
+{
+  StringOutputStream sos(key);
+  CodedOutputStream cos(&sos);
+
+  cos.SetSerializationDeterministic(true);
+  cos.WriteVarint64(path.ByteSizeLong());
+  path.SerializeWithCachedSizes(&cos);
+}
+
+Xpath PathCompiler::compile(const gnmi::Path &path, const gnmi::Path *prefix)
+{
+  string key;
+  Xpath xpath;
+
+  if (prefix != nullptr)
+    append_key(*prefix, &key);
+  key.push_back('\0'); //separate prefix from path
+  append_key(path, &key);
+
+  {
+    lock_guard<mutex> guard(lock);
+    Xpath *cached = cache.get(key);
+    if (cached != nullptr) {
+      Metrics::get().cacheHit(Metrics::PATH_CACHE);
+      return *cached;
+    }
+  }
+
+  /* Compile outside of the lock, it can throw on invalid key values */
+  Metrics::get().cacheMiss(Metrics::PATH_CACHE);
+  if (prefix != nullptr)
+    xpath = make_shared<const string>(gnmi_to_xpath(*prefix)
+                                      + gnmi_to_xpath(path));
+  else
+    xpath = make_shared<const string>(gnmi_to_xpath(path));
+
+  lock_guard<mutex> guard(lock);
+  cache.put(key, xpath);
+
+  return xpath;
+}
+
+/*
+ * Find the '/' starting the last step of a xpath, ignoring '/' inside quoted
+ * key values.
+ */
+static size_t last_step(const string &xpath)
+{
+  size_t last = string::npos;
+  char quote = 0;
+
+  for (size_t i = 0; i < xpath.size(); i++) {
+    char c = xpath[i];
+    if (quote) {
+      if (c == quote)
+        quote = 0;
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+    } else if (c == '/') {
+      last = i;
+    }
+  }
+
+  if (quote)
+    throw invalid_argument("Unterminated quote in " + xpath);
+
+  return last;
+}
+
+/* Parse one xpath step: name[key='value'][key2="value2"] */
+static void parse_step(const string &xpath, size_t begin, size_t end,
+                       gnmi::PathElem *elem)
+{
+  size_t pos = xpath.find('[', begin);
+
+  if (pos == string::npos || pos > end)
+    pos = end;
+  if (pos == begin)
+    throw invalid_argument("Empty node name in " + xpath);
+  elem->set_name(xpath.substr(begin, pos - begin));
+
+  while (pos < end) {
+    size_t eq, close;
+    char quote;
+
+    if (xpath[pos] != '[')
+      throw invalid_argument("Expected predicate in " + xpath);
+
+    eq = xpath.find('=', pos);
+    if (eq == string::npos || eq + 1 >= end)
+      throw invalid_argument("Malformed predicate in " + xpath);
+
+    quote = xpath[eq + 1];
+    if (quote != '\'' && quote != '"')
+      throw invalid_argument("Unquoted key value in " + xpath);
+
+    close = xpath.find(quote, eq + 2);
+    if (close == string::npos || close + 1 >= end || xpath[close + 1] != ']')
+      throw invalid_argument("Malformed predicate in " + xpath);
+
+    (*elem->mutable_key())[xpath.substr(pos + 1, eq - pos - 1)]
+      = xpath.substr(eq + 2, close - eq - 2);
+
+    pos = close + 2;
+  }
+}
+
+void PathCompiler::parse(const string &xpath, gnmi::Path *out)
+{
+  size_t last;
+  string head;
+
+  out->Clear();
+  if (xpath.empty() || xpath == "/")
+    return;
+
+  last = last_step(xpath);
+  if (last == string::npos)
+    throw invalid_argument("Relative xpath " + xpath);
+  head = xpath.substr(0, last);
+
+  /* Steps before the last one, from cache if possible */
+  if (!head.empty()) {
+    bool found = false;
+    {
+      lock_guard<mutex> guard(lock);
+      gnmi::Path *cached = parsed.get(head);
+      if (cached != nullptr) {
+        out->CopyFrom(*cached);
+        found = true;
+      }
+    }
+
+    if (!found) {
+      parse(head, out);
+      lock_guard<mutex> guard(lock);
+      parsed.put(head, *out);
+    }
+  }
+
+  parse_step(xpath, last + 1, xpath.size(), out->add_elem());
+}
+
+void PathCompiler::parse(const string &xpath, const gnmi::Path &request,
+                         const gnmi::Path *prefix, gnmi::Path *out)
+{
+  parse(xpath, out);
+
+  /* Make path relative to prefix */
+  if (prefix != nullptr && prefix->elem_size() > 0) {
+    int n = min(prefix->elem_size(), out->elem_size());
+    out->mutable_elem()->DeleteSubrange(0, n);
+    return;
+  }
+
+  /* Module name of first node goes in origin if request used origin */
+  if (!request.origin().empty() && out->elem_size() > 0) {
+    string *name = out->mutable_elem(0)->mutable_name();
+    size_t colon = name->find(':');
+
+    if (colon != string::npos) {
+      out->set_origin(name->substr(0, colon));
+      name->erase(0, colon + 1);
+    }
+  }
+}
+
+bool path_covers(const gnmi::Path &ancestor, const gnmi::Path &path)
+{
+  /* Root paths, and paths in the deprecated element field, are not
+   * compared */
+  if (ancestor.origin() != path.origin() || ancestor.elem_size() == 0
+      || ancestor.elem_size() > path.elem_size())
+    return false;
+
+  for (int i = 0; i < ancestor.elem_size(); i++) {
+    const gnmi::PathElem &outer = ancestor.elem(i);
+    const gnmi::PathElem &inner = path.elem(i);
+
+    if (outer.name() == "..." || inner.name() == "...")
+      return false; //any number of levels
+    if (outer.name() != "*" && outer.name() != inner.name())
+      return false;
+
+    /* Entries selected by inner keys must all be selected by outer keys */
+    for (auto &key : outer.key()) {
+      if (key.second == "*")
+        continue;
+      auto it = inner.key().find(key.first);
+      if (it == inner.key().end() || it->second != key.second)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+vector<bool> covered_paths(const vector<const gnmi::Path*> &paths)
+{
+  vector<bool> covered(paths.size(), false);
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    for (size_t j = 0; j < paths.size() && !covered[i]; j++) {
+      if (i == j || !path_covers(*paths[j], *paths[i]))
+        continue;
+      /* Identical paths cover each other, keep the first one */
+      covered[i] = j < i || !path_covers(*paths[i], *paths[j]);
+    }
+  }
+
+  return covered;
+}
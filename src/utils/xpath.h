@@ -0,0 +1,99 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _XPATH_H
+#define _XPATH_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <proto/gnmi.pb.h>
+
+#include "lru.h"
+
+/* Default number of compiled paths kept by a PathCompiler */
+#define PATH_CACHE_SIZE 4096
+
+/* Interned xpath, shared by every request compiling the same gNMI path */
+typedef std::shared_ptr<const std::string> Xpath;
+
+/*
+ * PathCompiler - Convert gNMI paths to canonical xpaths, and xpaths returned
+ * by sysrepo back to gNMI paths.
+ * Compiled xpaths are kept in a LRU cache keyed by the serialized gNMI
+ * path(s), so converting a path seen recently is a single hash lookup.
+ * Parsed xpaths are cached by prefix: entries of the same list share every
+ * step but the last one, which is the only one parsed on a hit.
+ * It is thread-safe.
+ */
+class PathCompiler {
+  public:
+    PathCompiler(size_t capacity = PATH_CACHE_SIZE)
+      : cache(capacity), parsed(capacity) {}
+    ~PathCompiler() {}
+
+    /*
+     * Compile prefix + path in a xpath.
+     * @param path gNMI path
+     * @param prefix optional gNMI prefix of path, can be nullptr
+     * @throw invalid_argument if a key value can not be expressed in xpath
+     */
+    Xpath compile(const gnmi::Path &path, const gnmi::Path *prefix = nullptr);
+
+    /*
+     * Parse an absolute xpath, as returned by sysrepo, in a gNMI path.
+     * Module names stay in PathElem names, e.g. "ietf-interfaces:interfaces".
+     * @throw invalid_argument if xpath is malformed
+     */
+    void parse(const std::string &xpath, gnmi::Path *out);
+
+    /*
+     * Parse xpath of data returned for a request path, in the same form
+     * as the request: relative to prefix, and with the module name in the
+     * origin field if the request used it.
+     * @param xpath absolute xpath of returned data
+     * @param request path requested by the client
+     * @param prefix prefix of request path, can be nullptr
+     * @param out gNMI path of returned data
+     * @throw invalid_argument if xpath is malformed
+     */
+    void parse(const std::string &xpath, const gnmi::Path &request,
+               const gnmi::Path *prefix, gnmi::Path *out);
+
+  private:
+    std::mutex lock; //protects cache and parsed
+    LRUCache<std::string, Xpath> cache;
+    LRUCache<std::string, gnmi::Path> parsed; //parsed xpath prefixes
+};
+
+/*
+ * True if every data node selected by path is also selected by ancestor,
+ * both relative to the same prefix: ancestor is path itself or one of its
+ * ancestors, with the same or wildcard names and key values.
+ * It is conservative, paths it can not compare are not covered.
+ */
+bool path_covers(const gnmi::Path &ancestor, const gnmi::Path &path);
+
+/*
+ * Flag the paths of a request covered by another path of the same request,
+ * their data is returned by the read of the other path. Of identical paths,
+ * only the first one is not covered.
+ */
+std::vector<bool> covered_paths(const std::vector<const gnmi::Path*> &paths);
+
+#endif // _XPATH_H
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2020 Yohan Pipereau
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compression test - a response compressed by the Compression policy must
+ * go out compressed on the wire.
+ * A gRPC server answers a unary call with a large, highly compressible
+ * message after Compression::apply(). The client reaches it through a TCP
+ * proxy counting the bytes sent by the server: they must be a fraction of
+ * the message size with compression, and more than it without.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/generic/async_generic_service.h>
+#include <grpcpp/generic/generic_stub.h>
+
+#include <gnmi/compression.h>
+
+using namespace std;
+
+#define MESSAGE_SIZE (1 << 20)
+#define METHOD "/gnmi.gNMI/Get"
+
+/* Answer one call with MESSAGE_SIZE bytes of 'a', after applying policy */
+static void serve(grpc::AsyncGenericService *service,
+                  grpc::ServerCompletionQueue *cq,
+                  const Compression &compression)
+{
+  grpc::GenericServerContext context;
+  grpc::GenericServerAsyncReaderWriter stream(&context);
+  string data(MESSAGE_SIZE, 'a');
+  grpc::Slice slice(data.data(), data.size());
+  grpc::ByteBuffer request, response(&slice, 1);
+  void *tag;
+  bool ok;
+
+  service->RequestCall(&context, &stream, cq, cq, &context);
+  if (!cq->Next(&tag, &ok) || !ok)
+    return;
+
+  compression.apply(&context, Compression::GET, MESSAGE_SIZE);
+
+  stream.Read(&request, &context);
+  cq->Next(&tag, &ok);
+  stream.WriteAndFinish(response, grpc::WriteOptions(), grpc::Status::OK,
+                        &context);
+  cq->Next(&tag, &ok);
+}
+
+/* Listen on a loopback port, return the socket and its port */
+static int listen_loopback(int *port)
+{
+  struct sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0
+      || bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))
+      || listen(fd, 1)
+      || getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len))
+    return -1;
+
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+/* Forward one connection to port, count bytes sent by the server */
+static void proxy(int listener, int port, atomic<size_t> *received)
+{
+  struct sockaddr_in addr = {};
+  int client = accept(listener, nullptr, nullptr);
+  int server = socket(AF_INET, SOCK_STREAM, 0);
+  char buf[65536];
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (client < 0 || server < 0
+      || connect(server, reinterpret_cast<struct sockaddr*>(&addr),
+                 sizeof(addr)))
+    return;
+
+  struct pollfd fds[2] = {{client, POLLIN, 0}, {server, POLLIN, 0}};
+  while (poll(fds, 2, -1) > 0) {
+    int from = fds[0].revents ? client : server;
+    int to = from == client ? server : client;
+    ssize_t len = read(from, buf, sizeof(buf));
+
+    if (len <= 0 || write(to, buf, len) != len)
+      break;
+    if (from == server)
+      *received += len;
+  }
+
+  close(client);
+  close(server);
+}
+
+/* Bytes received by a client calling a server with compression policy */
+static size_t call(const Compression &compression)
+{
+  grpc::ServerBuilder builder;
+  grpc::AsyncGenericService service;
+  int port = 0, proxy_port = 0;
+  atomic<size_t> received(0);
+
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterAsyncGenericService(&service);
+  unique_ptr<grpc::ServerCompletionQueue> server_cq =
+    builder.AddCompletionQueue();
+  unique_ptr<grpc::Server> server = builder.BuildAndStart();
+
+  int listener = listen_loopback(&proxy_port);
+  if (server == nullptr || listener < 0) {
+    cerr << "Can not start server" << endl;
+    exit(EXIT_FAILURE);
+  }
+  thread forwarder(proxy, listener, port, &received);
+  thread handler(serve, &service, server_cq.get(), cref(compression));
+
+  /* Clients accept deflate and gzip by default */
+  auto channel = grpc::CreateChannel("127.0.0.1:" + to_string(proxy_port),
+                                     grpc::InsecureChannelCredentials());
+  grpc::GenericStub stub(channel);
+  grpc::ClientContext context;
+  grpc::CompletionQueue cq;
+  grpc::ByteBuffer request, response;
+  grpc::Status status;
+  void *tag;
+  bool ok;
+
+  auto rpc = stub.PrepareUnaryCall(&context, METHOD, request, &cq);
+  rpc->StartCall();
+  rpc->Finish(&response, &status, reinterpret_cast<void*>(1));
+  cq.Next(&tag, &ok);
+
+  if (!status.ok() || response.Length() != MESSAGE_SIZE) {
+    cerr << "Call failed: " << status.error_message() << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  handler.join();
+  server->Shutdown();
+  server_cq->Shutdown();
+  while (server_cq->Next(&tag, &ok));
+  channel.reset();
+  forwarder.join();
+  close(listener);
+  cq.Shutdown();
+  while (cq.Next(&tag, &ok));
+
+  return received;
+}
+
+int main()
+{
+  Compression plain, gzip;
+  size_t plain_bytes, gzip_bytes;
+
+  gzip.setDefault(GRPC_COMPRESS_GZIP);
+
+  plain_bytes = call(plain);
+  gzip_bytes = call(gzip);
+
+  cout << "uncompressed: " << plain_bytes << " bytes, gzip: " << gzip_bytes
+       << " bytes" << endl;
+
+  if (plain_bytes < MESSAGE_SIZE || gzip_bytes >= MESSAGE_SIZE / 10) {
+    cerr << "Response was not compressed" << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}